@@ -31,6 +31,19 @@ DEALINGS IN THE SOFTWARE.
 #include <stddef.h>
 #include <stdlib.h>
 #include <memory.h>
+#include <new>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <type_traits>
+#include <vector>
+
+#include "ptrlist_index.h"
+#include "ptrlist_sort.h"
+#include "ptrlist_stats.h"
 
 #ifdef _MSC_VER
 #ifdef _WIN64
@@ -40,319 +53,1781 @@ typedef int ssize_t;
 #endif
 #endif
 
+/*
+ * Element storage policies: they decide where the elements itself are living.
+ * Pointer array is always managed by the PtrList itself.
+ */
+
+// Default storage: every element is a separated heap block
 template<class T>
-class PtrList
+struct PtrListHeapStorage
 {
-    T** m_data;
-    size_t m_size;
-    size_t m_sizeReserved;
+    // Elements are allocated by new, so they can be handed over to other lists
+    static const bool transferable = true;
+
+    template<typename... Args>
+    T* create(Args&&... args)
+    {
+        return new T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T* p)
+    {
+        delete p;
+    }
+
+    void destroyAll(T** data, size_t num)
+    {
+        for(size_t i = 0; i < num; i++)
+            delete data[i];
+    }
+
+    // Copies of src elements are created by `threads` threads at once
+    void createCopies(T** out, const T* const* src, size_t num, unsigned threads)
+    {
+        std::fill(out, out + num, nullptr);
+        try
+        {
+            PtrListParallel::forChunks(num, threads, [out, src](size_t b, size_t e)
+            {
+                for(size_t i = b; i < e; i++)
+                    out[i] = new T(*src[i]);
+            });
+        }
+        catch(...)
+        {
+            for(size_t i = 0; i < num; i++)
+                delete out[i];
+            throw;
+        }
+    }
+
+    void memoryUsage(T* const* data, size_t num, PtrListMemoryUsage& usage) const
+    {
+        usage.elements += sizeof(T) * num;
+        for(size_t i = 0; i < num; i++)
+            usage.overhead += PtrListMemoryUsage::blockOverhead(data[i], sizeof(T));
+    }
+};
+
+// Slab storage: elements are living in fixed-size pages which are never moved,
+// released slots are reused, and all pages are released at once on clear
+template<class T, size_t PageSize = 256>
+class PtrListSlabStorage
+{
+    static_assert(PageSize > 0, "Page size must be non-zero");
+    static_assert(alignof(T) <= alignof(max_align_t), "Over-aligned types are not supported");
+
+    union Slot
+    {
+        Slot* next;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type value;
+    };
+
+    struct Page
+    {
+        Page* next;
+        Slot  slots[PageSize];
+    };
+
+    Page*  m_pages;
+    Slot*  m_freeList;
+    size_t m_pageUsed;
+    size_t m_pagesCount;
+
+    Slot* allocSlot()
+    {
+        if(m_freeList)
+        {
+            Slot* s = m_freeList;
+            m_freeList = s->next;
+            return s;
+        }
+
+        if(!m_pages || m_pageUsed == PageSize)
+        {
+            Page* p = (Page*)malloc(sizeof(Page));
+            if(!p)
+                throw std::bad_alloc();
+            p->next = m_pages;
+            m_pages = p;
+            m_pageUsed = 0;
+            m_pagesCount++;
+        }
+
+        return &m_pages->slots[m_pageUsed++];
+    }
+
+    void freeSlot(Slot* s)
+    {
+        s->next = m_freeList;
+        m_freeList = s;
+    }
+
 public:
-    class iterator
+    // Elements belong to pages of this storage and can't leave it
+    static const bool transferable = false;
+
+    PtrListSlabStorage() :
+        m_pages(nullptr),
+        m_freeList(nullptr),
+        m_pageUsed(0),
+        m_pagesCount(0)
+    {}
+
+    PtrListSlabStorage(const PtrListSlabStorage&) = delete;
+    PtrListSlabStorage& operator=(const PtrListSlabStorage&) = delete;
+
+    // Pages are handed over together with the elements living in them
+    PtrListSlabStorage(PtrListSlabStorage&& o) :
+        m_pages(o.m_pages),
+        m_freeList(o.m_freeList),
+        m_pageUsed(o.m_pageUsed),
+        m_pagesCount(o.m_pagesCount)
     {
-        friend class PtrList;
-        T**     m_data;
-        size_t  m_pos;
-        iterator(T** d, size_t pos) :
-            m_data(d),
-            m_pos(pos)
-        {}
-    public:
-        iterator():
-            m_data(nullptr),
-            m_pos(0)
-        {}
-        iterator(const iterator& it) :
-            m_data(it.m_data),
-            m_pos(it.m_pos)
-        {}
-        bool operator == (const iterator& i)
+        o.m_pages = nullptr;
+        o.m_freeList = nullptr;
+        o.m_pageUsed = 0;
+        o.m_pagesCount = 0;
+    }
+
+    PtrListSlabStorage& operator=(PtrListSlabStorage&& o)
+    {
+        if(this != &o)
         {
-            return (m_pos == i.m_pos);
+            releasePages();
+            std::swap(m_pages, o.m_pages);
+            std::swap(m_freeList, o.m_freeList);
+            std::swap(m_pageUsed, o.m_pageUsed);
+            std::swap(m_pagesCount, o.m_pagesCount);
         }
-        bool operator != (const iterator& i)
+        return *this;
+    }
+
+    ~PtrListSlabStorage()
+    {
+        releasePages();
+    }
+
+    template<typename... Args>
+    T* create(Args&&... args)
+    {
+        Slot* s = allocSlot();
+        try
         {
-            return (m_pos != i.m_pos);
+            return new(&s->value) T(std::forward<Args>(args)...);
         }
-        friend iterator operator+(const iterator &it, int inc)
+        catch(...)
         {
-            iterator i = it;
-            i.m_pos += inc;
-            return i;
+            freeSlot(s);
+            throw;
         }
-        friend iterator operator-(const iterator &it, int inc)
+    }
+
+    void destroy(T* p)
+    {
+        p->~T();
+        freeSlot(reinterpret_cast<Slot*>(p));
+    }
+
+    void destroyAll(T** data, size_t num)
+    {
+        if(!std::is_trivially_destructible<T>::value)
         {
-            iterator i = it;
-            i.m_pos -= inc;
-            return i;
+            for(size_t i = 0; i < num; i++)
+                data[i]->~T();
         }
-        iterator& operator++()
+        releasePages();
+    }
+
+    // Slots are taken from pages by the calling thread, then the copies of
+    // src elements are constructed in them by `threads` threads at once
+    void createCopies(T** out, const T* const* src, size_t num, unsigned threads)
+    {
+        size_t taken = 0;
+        try
         {
-            m_pos++;
-            return *this;
+            for(; taken < num; taken++)
+                out[taken] = reinterpret_cast<T*>(allocSlot());
         }
-        iterator& operator++(int)
+        catch(...)
         {
-            m_pos++;
-            return *this;
+            while(taken > 0)
+                freeSlot(reinterpret_cast<Slot*>(out[--taken]));
+            throw;
         }
-        iterator& operator+=(int inc)
+
+        std::vector<unsigned char> built(num, 0);
+        try
         {
-            m_pos += inc;
-            return *this;
+            unsigned char* done = built.data();
+            PtrListParallel::forChunks(num, threads, [out, src, done](size_t b, size_t e)
+            {
+                for(size_t i = b; i < e; i++)
+                {
+                    new(out[i]) T(*src[i]);
+                    done[i] = 1;
+                }
+            });
         }
-        iterator& operator-=(int dec)
+        catch(...)
         {
-            m_pos -= dec;
-            return *this;
+            for(size_t i = 0; i < num; i++)
+            {
+                if(built[i])
+                    out[i]->~T();
+                freeSlot(reinterpret_cast<Slot*>(out[i]));
+            }
+            throw;
         }
-        T& operator*()
+    }
+
+    size_t pagesCount() const
+    {
+        return m_pagesCount;
+    }
+
+    // Free slots and page headers are counted as the overhead
+    void memoryUsage(T* const*, size_t num, PtrListMemoryUsage& usage) const
+    {
+        usage.elements += sizeof(T) * num;
+        for(const Page* p = m_pages; p; p = p->next)
+            usage.overhead += PtrListMemoryUsage::blockOverhead(p, sizeof(Page)) + sizeof(Page);
+        usage.overhead -= sizeof(T) * num;
+    }
+
+private:
+    void releasePages()
+    {
+        while(m_pages)
         {
-            return *(m_data[m_pos]);
+            Page* p = m_pages;
+            m_pages = p->next;
+            free(p);
+        }
+        m_freeList = nullptr;
+        m_pageUsed = 0;
+        m_pagesCount = 0;
+    }
+};
+
+/*
+ * Growth policies: they decide the new capacity of the pointer array
+ * when it has to be enlarged to store at least the `required` pointers.
+ */
+
+// Default: grow geometrically by 1.5 times, gives an amortised O(1) append
+struct PtrListGeometricGrowth
+{
+    static size_t grow(size_t capacity, size_t required)
+    {
+        size_t newCap = capacity + (capacity / 2);
+        if(newCap < 8)
+            newCap = 8;
+        return newCap < required ? required : newCap;
+    }
+};
+
+// Grow by fixed number of slots (the old behaviour, Step = 4)
+template<size_t Step = 4>
+struct PtrListFixedGrowth
+{
+    static_assert(Step > 0, "Step must be non-zero");
+    static size_t grow(size_t capacity, size_t required)
+    {
+        size_t newCap = capacity + Step;
+        return newCap < required ? required : newCap;
+    }
+};
+
+// Allocate exactly as much as required
+struct PtrListExactGrowth
+{
+    static size_t grow(size_t, size_t required)
+    {
+        return required;
+    }
+};
+
+/*
+ * Small buffer: the first InlineSlots pointers (and the null terminator) are
+ * kept inside of the list object, so short lists don't allocate the pointer
+ * array at all. It gets allocated only when the list grows beyond them.
+ */
+template<class T, size_t InlineSlots>
+class PtrListInlineBuffer
+{
+    T* m_slots[InlineSlots + 1];
+protected:
+    static const size_t inlineCapacity = InlineSlots + 1;
+    T** inlineSlots() { return m_slots; }
+    T* const* inlineSlots() const { return m_slots; }
+};
+
+// No buffer at all, the list object doesn't grow
+template<class T>
+class PtrListInlineBuffer<T, 0>
+{
+protected:
+    static const size_t inlineCapacity = 0;
+    T** inlineSlots() { return nullptr; }
+    T* const* inlineSlots() const { return nullptr; }
+};
+
+// Keeps the element storage, stateless storages take no room in the list object
+template<class Storage, bool = std::is_empty<Storage>::value>
+class PtrListStorageHolder
+{
+    Storage m_storage;
+protected:
+    Storage &elementStorage() { return m_storage; }
+    const Storage &elementStorage() const { return m_storage; }
+};
+
+template<class Storage>
+class PtrListStorageHolder<Storage, true> : private Storage
+{
+protected:
+    Storage &elementStorage() { return *this; }
+    const Storage &elementStorage() const { return *this; }
+};
+
+template<class T, class Storage = PtrListHeapStorage<T>, class Growth = PtrListGeometricGrowth, size_t InlineSlots = 0>
+class PtrList : public PtrListReallocationCounters,
+                private PtrListInlineBuffer<T, InlineSlots>,
+                private PtrListStorageHolder<Storage>
+{
+    typedef PtrListInlineBuffer<T, InlineSlots> InlineBuffer;
+    using InlineBuffer::inlineCapacity;
+    using InlineBuffer::inlineSlots;
+    using PtrListStorageHolder<Storage>::elementStorage;
+
+    // State of optional features, allocated by the first use of any of them
+    struct Extra
+    {
+        PtrListIndex<T>* index;
+        PtrListPositions<T>* positions;
+        // Ratio of holes to the size which makes appending to compact them
+        float compactRatio;
+
+        static float defaultCompactRatio()
+        {
+            return 0.5f;
+        }
+
+        Extra() :
+            index(nullptr),
+            positions(nullptr),
+            compactRatio(defaultCompactRatio())
+        {}
+
+        // Copy of other list gets the same setup, indices are filled by it
+        Extra(const Extra& o) :
+            index(o.index ? new PtrListIndex<T>(*o.index) : nullptr),
+            positions(o.positions ? new PtrListPositions<T>() : nullptr),
+            compactRatio(o.compactRatio)
+        {}
+
+        Extra& operator=(const Extra&) = delete;
+
+        ~Extra()
+        {
+            delete index;
+            delete positions;
         }
     };
 
-    iterator begin() { return iterator(m_data, 0u); }
-    iterator end()   { return iterator(m_data, m_size); }
+    // Pointer array has a headroom of m_head slots before the first element,
+    // m_sizeReserved is a full count of slots including the headroom
+    T** m_data;
+    size_t m_size;
+    size_t m_sizeReserved;
+    size_t m_head;
+    // Slots left by markRemoved(), these are closed by compact()
+    size_t m_removed;
+    Extra* m_extra;
+
+    // Marks a slot of removed element, differs from the null terminator, so iterators can skip it
+    static T* tombstone()
+    {
+        static char mark;
+        return reinterpret_cast<T*>(&mark);
+    }
+
+    // Optional state, allocated on the first use
+    Extra& extra()
+    {
+        if(!m_extra)
+            m_extra = new Extra();
+        return *m_extra;
+    }
+
+    size_t firstLive() const
+    {
+        size_t i = 0;
+        if(m_removed > 0)
+        {
+            while(m_data[i] == tombstone())
+                i++;
+        }
+        return i;
+    }
+
+    // Slot of the last element, the list must have one
+    size_t lastLive() const
+    {
+        size_t i = m_size - 1;
+        if(m_removed > 0)
+        {
+            while(m_data[i] == tombstone())
+                i--;
+        }
+        return i;
+    }
+
+    // Moves the slot position off a hole: forward, or backward while there are elements before it
+    static size_t skipHoles(T* const* data, size_t pos, bool backward)
+    {
+        if(!data)
+            return pos;
+        if(backward)
+        {
+            while(pos > 0 && data[pos] == tombstone())
+                pos--;
+        }
+        while(data[pos] == tombstone())
+            pos++;
+        return pos;
+    }
+
+    // Count of live elements before the slot
+    size_t liveBefore(size_t pos) const
+    {
+        size_t live = 0;
+        for(size_t i = 0; i < pos; i++)
+            live += (m_data[i] != tombstone());
+        return live;
+    }
+
+    // Closes holes before any operation which needs them closed, given slot positions are translated
+    void settle(size_t* a = nullptr, size_t* b = nullptr)
+    {
+        if(m_removed == 0)
+            return;
+        if(a)
+            *a = liveBefore(*a < m_size ? *a : m_size);
+        if(b)
+            *b = liveBefore(*b < m_size ? *b : m_size);
+        compact();
+    }
+
+    template<typename... Args>
+    T* createItem(Args&&... args)
+    {
+        T* p = elementStorage().create(std::forward<Args>(args)...);
+        countAllocations(1);
+        if(m_extra && m_extra->index)
+            m_extra->index->added(p);
+        return p;
+    }
+
+    void destroyItem(T* p)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->removed(p);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->removed(p);
+        elementStorage().destroy(p);
+        countFrees(1);
+    }
+
+    // Takes the element of other list or of the caller, it's position must be updated by the caller
+    void adoptItem(T* p)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->added(p);
+    }
+
+    // Forgets the element which ownership goes away, the slot must be dropped by the caller
+    T* releaseItem(T* p)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->removed(p);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->removed(p);
+        return p;
+    }
+
+    // Elements at this slot and after it were reordered
+    void shifted(size_t from)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->shifted(from);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->shifted(from);
+    }
+
+    // Slots were inserted or removed, elements after them were moved by num
+    void inserted(size_t at, size_t num)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->inserted(at, num);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->inserted(at, num);
+    }
+
+    void erased(size_t at, size_t num)
+    {
+        if(m_extra && m_extra->index)
+            m_extra->index->erased(at, num);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->erased(at, num);
+    }
+
+    void setIndex(PtrListIndex<T>* index)
+    {
+        delete extra().index;
+        m_extra->index = index;
+        reindex();
+    }
+
+    // Stores already created element at the given position
+    void insertItem(size_t at, T* p)
+    {
+        settle(&at);
+        if(at >= m_size)
+            at = m_size;
+
+        if(at < (m_size + 1) / 2)
+        {
+            // Front part is shorter: shift it into the headroom
+            if(m_head == 0)
+                growFront();
+            memmove(m_data - 1, m_data, sizeof(T*) * at);
+            countShifts(at);
+            m_data--;
+            m_head--;
+            m_data[at] = p;
+            m_size++;
+            inserted(at, 1);
+            return;
+        }
+
+        growFor(m_size + 2);
+        // The null terminator gets shifted too
+        memmove(m_data + at + 1, m_data + at, sizeof(T*) * (m_size - at + 1));
+        countShifts(m_size - at);
+        m_data[at] = p;
+        m_size++;
+        inserted(at, 1);
+    }
+
+    void appendItem(T* p)
+    {
+        if(m_removed > 0 && float(m_removed) > compactRatio() * float(m_size))
+            compact();
+        growFor(m_size + 2);
+        m_data[m_size] = p;
+        m_size++;
+        m_data[m_size] = nullptr;
+    }
+
+    // The pointer array is kept in the small buffer inside of the list
+    bool isInline() const
+    {
+        return inlineCapacity > 0 && m_data && m_data - m_head == inlineSlots();
+    }
+
+    void freeData()
+    {
+        if(m_data && !isInline())
+            free(m_data - m_head);
+    }
+
+    // Moves the array between the small buffer and the heap, returns false when
+    // the heap array has to be reallocated as usual
+    bool reallocInline(size_t sz)
+    {
+        T** base;
+        if(isInline())
+        {
+            if(sz <= inlineCapacity)
+                return true;
+            base = (T**)malloc(sizeof(T*) * sz);
+            if(!base)
+                throw std::bad_alloc();
+            memcpy(base, inlineSlots(), sizeof(T*) * (m_head + m_size + 1));
+            countReallocation(sizeof(T*) * (m_head + m_size + 1));
+            m_sizeReserved = sz;
+        }
+        else if(sz <= inlineCapacity && m_head == 0)
+        {
+            base = inlineSlots();
+            if(m_data)
+            {
+                memcpy(base, m_data, sizeof(T*) * (m_size + 1));
+                free(m_data);
+            }
+            else
+                base[0] = nullptr;
+            m_sizeReserved = inlineCapacity;
+        }
+        else
+            return false;
+        m_data = base + m_head;
+        return true;
+    }
+
+    void reallocData(size_t sz)
+    {
+        if(inlineCapacity > 0 && reallocInline(sz))
+            return;
+        size_t newSize = sizeof(T*) * sz;
+        // The old array stays untouched when the allocation fails
+        if(m_data == 0)
+        {
+            // The first array gets the terminator of the empty list
+            T** base = (T**)malloc(newSize);
+            if(!base)
+                throw std::bad_alloc();
+            countReallocation(0);
+            m_data = base;
+            m_data[0] = nullptr;
+        }
+        else
+        {
+            T** base = (T**)realloc(m_data - m_head, newSize);
+            if(!base)
+                throw std::bad_alloc();
+            countReallocation(sizeof(T*) * (m_head + m_size + 1));
+            m_data = base + m_head;
+        }
+        m_sizeReserved = sz;
+    }
+
+    // One extra slot is always kept for the null terminator after the last element
+    void growFor(size_t required)
+    {
+        if(required <= m_sizeReserved - m_head)
+            return;
+
+        // Reuse the headroom left by pop_front() instead of growing the array
+        if(m_head > 0 && m_head >= m_size && required <= m_sizeReserved)
+        {
+            T** base = m_data - m_head;
+            memmove(base, m_data, sizeof(T*) * (m_size + 1));
+            countShifts(m_size);
+            m_data = base;
+            m_head = 0;
+            return;
+        }
+
+        // The small buffer is taken first, it's size doesn't follow the growth policy
+        if(!m_data && required <= inlineCapacity)
+            reallocData(inlineCapacity);
+        else
+            reallocData(Growth::grow(m_sizeReserved, m_head + required));
+    }
+
+    /*
+     * Makes num unfilled slots at the given position by one shift of the shorter
+     * part (the headroom is used if it's big enough), returns the position
+     */
+    size_t openGap(size_t at, size_t num)
+    {
+        settle(&at);
+        if(at > m_size)
+            at = m_size;
+        if(at < m_size - at && m_head >= num)
+        {
+            memmove(m_data - num, m_data, sizeof(T*) * at);
+            countShifts(at);
+            m_data -= num;
+            m_head -= num;
+        }
+        else
+        {
+            growFor(m_size + num + 1);
+            memmove(m_data + at + num, m_data + at, sizeof(T*) * (m_size - at + 1));
+            countShifts(m_size - at);
+        }
+        m_size += num;
+        inserted(at, num);
+        return at;
+    }
+
+    // Removes num unfilled slots left by a failed range insertion
+    void closeGap(size_t at, size_t num)
+    {
+        memmove(m_data + at, m_data + at + num, sizeof(T*) * (m_size - at - num + 1));
+        m_size -= num;
+        erased(at, num);
+    }
+
+    // Closes num slots which elements are destroyed or handed over already
+    void dropSlots(size_t at, size_t num)
+    {
+        size_t del_to = at + num;
+        erased(at, num);
+
+        if(at < m_size - del_to)
+        {
+            // Front part is shorter: shift it and grow the headroom
+            memmove(m_data + num, m_data, sizeof(T*) * at);
+            countShifts(at);
+            m_data += num;
+            m_head += num;
+            m_size -= num;
+            return;
+        }
+
+        // The null terminator gets shifted too
+        memmove(m_data + at, m_data + del_to, sizeof(T*) * (m_size - del_to + 1));
+        countShifts(m_size - del_to);
+        m_size -= num;
+        if(m_size == 0 && m_head > 0)
+        {
+            m_data -= m_head;
+            m_head = 0;
+            m_data[0] = nullptr;
+        }
+    }
+
+    // Pointers are handed over without touching elements
+    void insertMoved(size_t at, PtrList& array, std::true_type)
+    {
+        splice(at, array);
+    }
+
+    void insertMoved(size_t at, PtrList& array, std::false_type)
+    {
+        insertRange(at, array.m_size - array.m_removed, std::make_move_iterator(array.begin()));
+    }
+
+    // Rotates [first, last) into the position dst, positions are given before the move
+    void spliceSelf(size_t dst, size_t first, size_t last)
+    {
+        if(m_removed > 0)
+            dst = liveBefore(dst < m_size ? dst : m_size);
+        settle(&first, &last);
+        assert(first <= last && last <= m_size);
+        if(dst > m_size)
+            dst = m_size;
+        if(dst < first)
+        {
+            std::rotate(m_data + dst, m_data + first, m_data + last);
+            countShifts(last - dst);
+            shifted(dst);
+        }
+        else if(dst > last)
+        {
+            std::rotate(m_data + first, m_data + last, m_data + dst);
+            countShifts(dst - first);
+            shifted(first);
+        }
+    }
+
+    // Creates num elements from the sequence at the given position by one shift
+    template<class InputIt>
+    void insertRange(size_t at, size_t num, InputIt first)
+    {
+        if(num == 0)
+            return;
+        at = openGap(at, num);
+        size_t done = 0;
+        try
+        {
+            for(; done < num; ++done, ++first)
+                m_data[at + done] = createItem(*first);
+        }
+        catch(...)
+        {
+            closeGap(at + done, num - done);
+            throw;
+        }
+    }
+
+    // Relocates the array to have a free headroom before the first element
+    void growFront()
+    {
+        size_t backRoom = m_data ? (m_sizeReserved - m_head - m_size) : 1;
+        size_t total = Growth::grow(m_sizeReserved, m_size + backRoom + 1);
+        size_t room = total - m_size - backRoom;
+        T** base = (T**)malloc(sizeof(T*) * total);
+        if(!base)
+            throw std::bad_alloc();
+        countReallocation(m_data ? sizeof(T*) * (m_size + 1) : 0);
+        if(m_data)
+        {
+            memcpy(base + room, m_data, sizeof(T*) * (m_size + 1));
+            freeData();
+        }
+        else
+            base[room] = nullptr;
+        m_data = base + room;
+        m_head = room;
+        m_sizeReserved = total;
+    }
+public:
+    class iterator
+    {
+        friend class PtrList;
+        T**     m_data;
+        size_t  m_pos;
+        iterator(T** d, size_t pos) :
+            m_data(d),
+            m_pos(pos)
+        {}
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef T                           value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef T*                          pointer;
+        typedef T&                          reference;
+
+        iterator():
+            m_data(nullptr),
+            m_pos(0)
+        {}
+        bool operator == (const iterator& i) const
+        {
+            return (m_pos == i.m_pos);
+        }
+        bool operator != (const iterator& i) const
+        {
+            return (m_pos != i.m_pos);
+        }
+        // Arithmetic counts slots, an iterator which lands on a hole moves to the nearest element
+        friend iterator operator+(const iterator &it, std::ptrdiff_t inc)
+        {
+            iterator i = it;
+            i += inc;
+            return i;
+        }
+        friend iterator operator-(const iterator &it, std::ptrdiff_t inc)
+        {
+            iterator i = it;
+            i -= inc;
+            return i;
+        }
+        // Slots of removed elements are skipped, the null terminator stops it
+        iterator& operator++()
+        {
+            do
+                m_pos++;
+            while(m_data[m_pos] == tombstone());
+            return *this;
+        }
+        iterator operator++(int)
+        {
+            iterator old = *this;
+            operator++();
+            return old;
+        }
+        iterator& operator+=(std::ptrdiff_t inc)
+        {
+            m_pos += inc;
+            m_pos = skipHoles(m_data, m_pos, inc < 0);
+            return *this;
+        }
+        iterator& operator-=(std::ptrdiff_t dec)
+        {
+            m_pos -= dec;
+            m_pos = skipHoles(m_data, m_pos, dec > 0);
+            return *this;
+        }
+        T& operator*() const
+        {
+            return *(m_data[m_pos]);
+        }
+        T* operator->() const
+        {
+            return m_data[m_pos];
+        }
+    };
+
+    class const_iterator
+    {
+        friend class PtrList;
+        T* const* m_data;
+        size_t  m_pos;
+        const_iterator(T* const* d, size_t pos) :
+            m_data(d),
+            m_pos(pos)
+        {}
+    public:
+        typedef std::forward_iterator_tag   iterator_category;
+        typedef T                           value_type;
+        typedef std::ptrdiff_t              difference_type;
+        typedef const T*                    pointer;
+        typedef const T&                    reference;
+
+        const_iterator():
+            m_data(nullptr),
+            m_pos(0)
+        {}
+        const_iterator(const iterator& it) :
+            m_data(it.m_data),
+            m_pos(it.m_pos)
+        {}
+        bool operator == (const const_iterator& i) const
+        {
+            return (m_pos == i.m_pos);
+        }
+        bool operator != (const const_iterator& i) const
+        {
+            return (m_pos != i.m_pos);
+        }
+        const_iterator& operator++()
+        {
+            do
+                m_pos++;
+            while(m_data[m_pos] == tombstone());
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator old = *this;
+            operator++();
+            return old;
+        }
+        const_iterator& operator+=(std::ptrdiff_t inc)
+        {
+            m_pos += inc;
+            m_pos = skipHoles(m_data, m_pos, inc < 0);
+            return *this;
+        }
+        const T& operator*() const
+        {
+            return *(m_data[m_pos]);
+        }
+        const T* operator->() const
+        {
+            return m_data[m_pos];
+        }
+    };
+
+    typedef T       value_type;
+    typedef size_t  size_type;
+
+    iterator begin() { return iterator(m_data, firstLive()); }
+    iterator end()   { return iterator(m_data, m_size); }
+    const_iterator begin() const { return const_iterator(m_data, firstLive()); }
+    const_iterator end() const   { return const_iterator(m_data, m_size); }
+    const_iterator cbegin() const { return const_iterator(m_data, firstLive()); }
+    const_iterator cend() const   { return const_iterator(m_data, m_size); }
+
+    PtrList() :
+        m_data(nullptr),
+        m_size(0),
+        m_sizeReserved(0),
+        m_head(0),
+        m_removed(0),
+        m_extra(nullptr)
+    {}
+
+    PtrList(size_t size) :
+        m_data(nullptr),
+        m_size(0),
+        m_sizeReserved(0),
+        m_head(0),
+        m_removed(0),
+        m_extra(nullptr)
+    {
+        resize(size);
+    }
+
+    PtrList(const PtrList& o):
+        PtrListReallocationCounters(),
+        m_data(nullptr),
+        m_size(0),
+        m_sizeReserved(0),
+        m_head(0),
+        m_removed(0),
+        m_extra(o.m_extra ? new Extra(*o.m_extra) : nullptr)
+    {
+        reallocData(o.m_size - o.m_removed + 1);
+        for(const T& t : o)
+            m_data[m_size++] = createItem(t);
+        m_data[m_size] = nullptr;
+    }
+
+    // Takes the pointer array, elements and index of other list, which becomes empty
+    PtrList(PtrList&& o) :
+        m_data(nullptr),
+        m_size(0),
+        m_sizeReserved(0),
+        m_head(0),
+        m_removed(0),
+        m_extra(nullptr)
+    {
+        swap(o);
+    }
+
+    PtrList& operator=(const PtrList& o)
+    {
+        if (this != &o)
+        {
+            // The optional setup is copied like by the copy constructor
+            Extra* e = o.m_extra ? new Extra(*o.m_extra) : nullptr;
+            clear();
+            delete m_extra;
+            m_extra = e;
+            reallocData(o.m_size - o.m_removed + 1);
+            for(const T& t : o)
+                m_data[m_size++] = createItem(t);
+            m_data[m_size] = nullptr;
+        }
+        return *this;
+    }
+
+    PtrList& operator=(PtrList&& o)
+    {
+        if (this != &o)
+        {
+            clear();
+            delete m_extra;
+            m_extra = nullptr;
+            swap(o);
+        }
+        return *this;
+    }
+
+    /*
+     * Deep copy like the copy constructor, but elements are copied by `threads`
+     * threads at once (threads = 0 uses all hardware threads). Lists with less
+     * than `threshold` elements per thread, and lists of types which aren't
+     * marked as PtrListThreadSafeCopy, are copied on the calling thread.
+     */
+    PtrList clone(unsigned threads = 0, size_t threshold = PtrListParallel::defaultCopyThreshold) const
+    {
+        size_t num = m_size - m_removed;
+        if(!PtrListThreadSafeCopy<T>::value)
+            threads = 1;
+        threads = PtrListParallel::threadsFor(num, threads, threshold);
+        if(threads < 2)
+            return PtrList(*this);
+
+        const T* const* src = m_data;
+        std::vector<const T*> live;
+        if(m_removed > 0)
+        {
+            live.reserve(num);
+            for(const T& t : *this)
+                live.push_back(&t);
+            src = live.data();
+        }
+
+        PtrList ret;
+        ret.reallocData(num + 1);
+        ret.elementStorage().createCopies(ret.m_data, src, num, threads);
+        ret.m_size = num;
+        ret.m_data[num] = nullptr;
+        ret.countAllocations(num);
+        if(m_extra)
+        {
+            ret.m_extra = new Extra(*m_extra);
+            ret.reindex();
+        }
+        return ret;
+    }
+
+    // Exchanges the whole content with other list in O(1)
+    void swap(PtrList& o)
+    {
+        std::swap(m_data, o.m_data);
+        std::swap(m_size, o.m_size);
+        std::swap(m_sizeReserved, o.m_sizeReserved);
+        std::swap(m_head, o.m_head);
+        std::swap(elementStorage(), o.elementStorage());
+        std::swap(m_removed, o.m_removed);
+        std::swap(m_extra, o.m_extra);
+
+        // Arrays kept in small buffers are exchanged by content
+        if(inlineCapacity > 0)
+        {
+            bool inlineThis = o.m_data && o.m_data - o.m_head == inlineSlots();
+            bool inlineOther = m_data && m_data - m_head == o.inlineSlots();
+            if(inlineThis || inlineOther)
+                std::swap_ranges(inlineSlots(), inlineSlots() + inlineCapacity, o.inlineSlots());
+            if(inlineThis)
+                o.m_data = o.inlineSlots() + o.m_head;
+            if(inlineOther)
+                m_data = inlineSlots() + m_head;
+        }
+    }
+
+    ~PtrList()
+    {
+        clear();
+        delete m_extra;
+    }
+
+    void clear()
+    {
+        settle();
+        if(m_extra && m_extra->index)
+            m_extra->index->clear();
+        if(m_extra && m_extra->positions)
+            m_extra->positions->clear();
+        if(m_data)
+        {
+            elementStorage().destroyAll(m_data, m_size);
+            countFrees(m_size);
+            freeData();
+        }
+        m_data = nullptr;
+        m_size = 0;
+        m_sizeReserved = 0;
+        m_head = 0;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    size_t count() const
+    {
+        return m_size;
+    }
+
+    size_t capacity() const
+    {
+        return m_sizeReserved > 0 ? m_sizeReserved - m_head - 1 : 0;
+    }
+
+    void resize(size_t sz)
+    {
+        settle();
+        if(sz == m_size)
+            return;
+
+        if(sz < m_size)
+        {
+            erased(sz, m_size - sz);
+            while(sz < m_size)
+            {
+                T* p = m_data[(m_size--) - 1];
+                destroyItem(p);
+            }
+        }
+        else
+        {
+            growFor(sz + 1);
+            while( m_size < sz )
+                m_data[m_size++] = createItem();
+        }
+        m_data[m_size] = nullptr;
+    }
+
+    // Makes the capacity to be at least `sz` elements
+    void reserve(size_t sz)
+    {
+        if(sz + 1 > m_sizeReserved - m_head)
+            reallocData(m_head + sz + 1);
+    }
+
+    // Drops the headroom and unused capacity of the pointer array
+    void shrink_to_fit()
+    {
+        settle();
+        if(!m_data)
+            return;
+
+        if(m_size == 0)
+        {
+            freeData();
+            m_data = nullptr;
+            m_sizeReserved = 0;
+            m_head = 0;
+            return;
+        }
+
+        if(m_head > 0)
+        {
+            T** base = m_data - m_head;
+            memmove(base, m_data, sizeof(T*) * (m_size + 1));
+            countShifts(m_size);
+            m_data = base;
+            m_head = 0;
+        }
+
+        if(m_sizeReserved > m_size + 1)
+            reallocData(m_size + 1);
+    }
+
+    // Memory taken by the pointer array and elements, O(n) for the heap storage
+    PtrListMemoryUsage memoryUsage() const
+    {
+        PtrListMemoryUsage usage;
+        if(m_data && !isInline())
+        {
+            usage.pointerArray = sizeof(T*) * m_sizeReserved;
+            usage.slack = sizeof(T*) * (m_sizeReserved - m_size - 1);
+            usage.overhead += PtrListMemoryUsage::blockOverhead(m_data - m_head, usage.pointerArray);
+        }
+        if(m_removed > 0)
+        {
+            std::vector<T*> live;
+            live.reserve(m_size - m_removed);
+            for(size_t i = 0; i < m_size; i++)
+            {
+                if(m_data[i] != tombstone())
+                    live.push_back(m_data[i]);
+            }
+            usage.slack += sizeof(T*) * m_removed;
+            elementStorage().memoryUsage(live.data(), live.size(), usage);
+        }
+        else
+            elementStorage().memoryUsage(m_data, m_size, usage);
+        return usage;
+    }
+
+    /*
+     * Hash index: makes contains(), indexOf(), find() and removal by value
+     * to don't walk the whole list. Elements must not change their hashed
+     * content while they are in the list, or reindex() must be called after.
+     */
+
+    // Index elements by std::hash<T> of their content
+    void enableIndex()
+    {
+        setIndex(new PtrListIndex<T>(PtrListValueHasher<T>()));
+    }
+
+    // Index elements by std::hash of the key given by keyFn(const T&)
+    template<class KeyFn>
+    void enableIndex(KeyFn keyFn)
+    {
+        setIndex(new PtrListIndex<T>(PtrListKeyHasher<T, KeyFn>(keyFn)));
+    }
+
+    void disableIndex()
+    {
+        if(!m_extra)
+            return;
+        delete m_extra->index;
+        m_extra->index = nullptr;
+    }
+
+    bool isIndexed() const
+    {
+        return m_extra && m_extra->index;
+    }
+
+    void reindex()
+    {
+        settle();
+        if(!m_extra || !m_extra->index)
+            return;
+        m_extra->index->clear();
+        m_extra->index->reserve(m_size);
+        for(size_t i = 0; i < m_size; i++)
+            m_extra->index->added(m_data[i]);
+    }
+
+    /*
+     * Lookups by the address of element. Without any index they compare
+     * pointers only, the address index (or the hash index, which keeps the
+     * same positions) makes them amortised O(1).
+     */
+
+    void enableAddressIndex()
+    {
+        if(!extra().positions)
+            m_extra->positions = new PtrListPositions<T>();
+    }
+
+    void disableAddressIndex()
+    {
+        if(!m_extra)
+            return;
+        delete m_extra->positions;
+        m_extra->positions = nullptr;
+    }
+
+    bool isAddressIndexed() const
+    {
+        return m_extra && m_extra->positions;
+    }
+
+    // Position of the element which has the given address, or -1 if it's not in the list
+    ssize_t indexOfPtr(const T* p) const
+    {
+        size_t at = m_size;
+        if(m_extra && m_extra->positions)
+        {
+            size_t visits = m_extra->positions->visits();
+            at = m_extra->positions->position(p, m_data, m_size);
+            countIndexVisits(m_extra->positions->visits() - visits);
+        }
+        else if(m_extra && m_extra->index)
+        {
+            size_t visits = m_extra->index->visits();
+            at = m_extra->index->position(p, m_data, m_size);
+            countIndexVisits(m_extra->index->visits() - visits);
+        }
+        else
+        {
+            for(size_t i = 0; i < m_size; i++)
+            {
+                if(m_data[i] == p)
+                {
+                    at = i;
+                    break;
+                }
+            }
+        }
+        return at < m_size ? ssize_t(at) : -1;
+    }
+
+    iterator iteratorFor(T* p)
+    {
+        ssize_t at = indexOfPtr(p);
+        return iterator(m_data, at < 0 ? m_size : size_t(at));
+    }
+
+    // Removes exactly this element even if there are equal ones, returns false if it's not in the list
+    bool removeByPtr(T* p)
+    {
+        ssize_t at = indexOfPtr(p);
+        if(at < 0)
+            return false;
+        removeAt(size_t(at));
+        return true;
+    }
+
+    bool contains(const T& item)
+    {
+        settle();
+        return static_cast<const PtrList*>(this)->contains(item);
+    }
+
+    ssize_t indexOf(const T& item)
+    {
+        settle();
+        return static_cast<const PtrList*>(this)->indexOf(item);
+    }
+
+    iterator find(const T& item)
+    {
+        settle();
+        ssize_t at = static_cast<const PtrList*>(this)->indexOf(item);
+        return iterator(m_data, at < 0 ? m_size : size_t(at));
+    }
+
+    /*
+     * Lookups of a const list don't close holes, they're skipped by the scan
+     * and found positions are slots like the ones of operator[]
+     */
+    bool contains(const T& item) const
+    {
+        if(m_extra && m_extra->index)
+            return m_extra->index->contains(item);
+        return indexOf(item) >= 0;
+    }
+
+    ssize_t indexOf(const T& item) const
+    {
+        if(m_extra && m_extra->index)
+            return m_extra->index->indexOf(item, m_data, m_size);
+        size_t compared = 0;
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(m_data[i] == tombstone())
+                continue;
+            compared++;
+            if(*m_data[i] == item)
+            {
+                countComparisons(compared);
+                return ssize_t(i);
+            }
+        }
+        countComparisons(compared);
+        return -1;
+    }
+
+    const_iterator find(const T& item) const
+    {
+        ssize_t at = indexOf(item);
+        return const_iterator(m_data, at < 0 ? m_size : size_t(at));
+    }
+
+    bool removeOne(const T& item)
+    {
+        settle();
+        if(m_extra && m_extra->index)
+        {
+            ssize_t at = indexOf(item);
+            if(at < 0)
+                return false;
+            removeAt(size_t(at));
+            return true;
+        }
+        size_t compared = 0;
+        bool removed = removeOneIf([&item, &compared](const T& v) { compared++; return v == item; });
+        countComparisons(compared);
+        return removed;
+    }
+
+    size_t removeAll(const T& item)
+    {
+        settle();
+        if(m_extra && m_extra->index && !m_extra->index->contains(item))
+            return 0;
+        countComparisons(m_size);
+        return removeIf([&item](const T& v) { return v == item; });
+    }
+
+    // Removes the first element that matches the predicate
+    template<class Predicate>
+    bool removeOneIf(Predicate pred)
+    {
+        settle();
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(pred(*m_data[i]))
+            {
+                removeAt(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Removes all elements that match the predicate by one pass, returns count of removed
+    template<class Predicate>
+    size_t removeIf(Predicate pred)
+    {
+        // Matching elements are marked as removed, then all holes are closed by one pass
+        size_t before = m_removed;
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(m_data[i] != tombstone() && pred(*m_data[i]))
+                markRemoved(i);
+        }
+        size_t removed = m_removed - before;
+        compact();
+        return removed;
+    }
+
+    iterator erase(iterator pos)
+    {
+        assert(pos.m_pos <= m_size);
+        size_t at = pos.m_pos;
+        settle(&at);
+        removeAt(at, 1);
+        return iterator(m_data, at);
+    }
+
+    iterator erase(iterator from, iterator to)
+    {
+        assert(from.m_pos <= m_size);
+        assert(to.m_pos <= m_size);
+        assert(to.m_pos >= from.m_pos);
+        if(from == to)
+            return from;
+        size_t at = from.m_pos, end = to.m_pos;
+        settle(&at, &end);
+        removeAt(at, end - at);
+        return iterator(m_data, at);
+    }
 
-    PtrList() :
-        m_data(nullptr),
-        m_size(0),
-        m_sizeReserved(0)
-    {}
+    void removeAt(size_t at)
+    {
+        removeAt(at, 1);
+    }
 
-    PtrList(size_t size) :
-        m_data(nullptr),
-        m_size(0),
-        m_sizeReserved(0)
+    void removeAt(size_t at, size_t num)
     {
-        resize(size);
+        size_t del_to = at + num;
+        settle(&at, &del_to);
+        num = del_to - at;
+        if(num == 0)
+            return;
+        assert(m_size > 0);
+        assert(m_size >= at + num);
+        size_t i = at;
+        while(i < del_to)
+            destroyItem(m_data[i++]);
+        dropSlots(at, num);
     }
 
-    PtrList(const PtrList& o):
-        m_data(nullptr),
-        m_size(0),
-        m_sizeReserved(0)
+    void pop_back()
     {
-        reserve(m_size);
-        for(size_t i=0; i < o.m_size; i++)
-        {
-            m_data[i] = new T(*o.m_data[i]);
-        }
-        m_size = o.m_size;
+        settle();
+        removeAt(m_size - 1);
     }
 
-    PtrList& operator=(const PtrList& o)
+    void pop_front()
     {
-        if (this != &o)
-        {
-            clear();
-            m_size = o.m_size;
-            reserve(o.m_size);
-            for(size_t i = 0; i < o.m_size; i++)
-                m_data[i] = new T(*o.m_data[i]);
-        }
-        return *this;
+        settle();
+        removeAt(0);
     }
 
-    ~PtrList()
+    /*
+     * Deferred removal: markRemoved() destroys the element and leaves a hole
+     * (tombstone) in it's slot, so positions of other elements are not changed
+     * and nothing is shifted. Iterators skip holes, size() still counts them.
+     * compact() closes all holes by one pass. Any operation which inserts or
+     * removes by position, looks elements up by value or sorts them closes
+     * holes first (given positions are translated), and appending does it
+     * when holes are more than compactRatio() of the size.
+     */
+
+    void markRemoved(size_t at)
     {
-        clear();
+        assert(at < m_size);
+        assert(m_data[at] != tombstone());
+        destroyItem(m_data[at]);
+        m_data[at] = tombstone();
+        m_removed++;
     }
 
-    void clear()
+    void markRemoved(iterator it)
     {
-        if(m_data)
-        {
-            for(size_t i = 0; i < m_size; i++)
-            {
-                T* p = m_data[i];
-                delete p;
-            }
-            free(m_data);
-        }
-        m_data = nullptr;
-        m_size = 0;
-        m_sizeReserved = 0;
+        markRemoved(it.m_pos);
     }
 
-    size_t size() const
+    // Returns false if the element is not in the list
+    bool markRemoved(T* p)
     {
-        return m_size;
+        ssize_t at = indexOfPtr(p);
+        if(at < 0)
+            return false;
+        markRemoved(size_t(at));
+        return true;
     }
 
-    size_t count() const
+    bool isRemoved(size_t at) const
     {
-        return m_size;
+        assert(at < m_size);
+        return m_data[at] == tombstone();
     }
 
-    size_t capacity() const
+    size_t removedCount() const
     {
-        return m_sizeReserved;
+        return m_removed;
     }
 
-    void resize(size_t sz)
+    void compact()
     {
-        if(sz == m_size)
+        if(m_removed == 0)
             return;
-
-        if(sz < m_size)
-        {
-            while(sz < m_size)
-            {
-                T* p = m_data[(m_size--) - 1];
-                delete p;
-            }
-        }
-        else
+        size_t moveTo = 0, runFrom = 0, firstRemoved = m_size;
+        for(size_t i = 0; i < m_size; i++)
         {
-            if(sz > m_sizeReserved)
-                reserve(sz - m_sizeReserved);
-            while( m_size < sz )
-                m_data[m_size++] = new T;
+            if(m_data[i] != tombstone())
+                continue;
+            if(firstRemoved == m_size)
+                firstRemoved = i;
+            if(moveTo != runFrom)
+                memmove(m_data + moveTo, m_data + runFrom, sizeof(T*) * (i - runFrom));
+            moveTo += i - runFrom;
+            runFrom = i + 1;
         }
+        // The last run with the null terminator
+        memmove(m_data + moveTo, m_data + runFrom, sizeof(T*) * (m_size - runFrom + 1));
+        moveTo += m_size - runFrom;
+        countShifts(moveTo - firstRemoved);
+        m_size = moveTo;
+        m_removed = 0;
+        shifted(firstRemoved);
     }
 
-    void reserve(size_t sz)
+    // 1 or more disables the compaction by appending
+    void setCompactRatio(float ratio)
     {
-        sz += m_sizeReserved;
-        size_t newSize = sizeof(T*) * sz;
-        if(m_data == 0)
-            m_data = (T**)malloc(newSize);
-        else
-            m_data = (T**)realloc(m_data, newSize);
-        assert(m_data);
-        m_sizeReserved = sz;
+        extra().compactRatio = ratio;
     }
 
-    bool contains(const T& item)
+    float compactRatio() const
     {
-        for(size_t i = 0; i < m_size; i++)
-        {
-            if(*m_data[i] == item)
-                return true;
-        }
-        return false;
+        return m_extra ? m_extra->compactRatio : Extra::defaultCompactRatio();
     }
 
-    ssize_t indexOf(const T& item)
+    /*
+     * Unordered removal: the last element takes the slot of removed one,
+     * so nothing is shifted and the removal is O(1), but the order isn't kept
+     */
+
+    void removeAtUnordered(size_t at)
     {
-        for(size_t i = 0; i < m_size; i++)
+        settle(&at);
+        assert(m_size > at);
+        size_t last = m_size - 1;
+        if(at != last)
         {
-            if(*m_data[i] == item)
-                return ssize_t(i);
+            swap(at, last);
+            countShifts(1);
         }
-        return -1;
+        removeAt(last);
     }
 
-    iterator find(const T& item)
+    bool removeOneUnordered(const T& item)
     {
-        iterator i = begin();
-        for(; i != end(); i++)
-        {
-            if(*i == item)
-                break;
-        }
-        return i;
+        ssize_t at = indexOf(item);
+        if(at < 0)
+            return false;
+        removeAtUnordered(size_t(at));
+        return true;
     }
 
-    void removeOne(const T& item)
+    // Removes all elements that match the predicate by one pass, returns count of removed
+    template<class Predicate>
+    size_t removeIfUnordered(Predicate pred)
     {
-        size_t i = 0, moveTo = m_size;
-        for(; i < m_size; i++)
+        settle();
+        size_t removed = 0, i = 0;
+        while(i < m_size)
         {
-            if(*m_data[i] == item)
+            // The element moved into this slot is checked on the next step
+            if(pred(*m_data[i]))
             {
-                delete m_data[i];
-                moveTo = i;
-                i++;
-                break;
+                removeAtUnordered(i);
+                removed++;
             }
+            else
+                i++;
         }
-        for(; i < m_size; i++)
-        {
-            m_data[moveTo++] = m_data[i];
-        }
-        m_size--;
-        m_data[m_size] = nullptr;
+        return removed;
     }
 
-    void removeAll(const T& item)
+    /*
+     * Ownership transfer: elements are handed over between lists, or to and from
+     * the caller, without any copy or allocation, so they keep their addresses.
+     * Available with the heap storage only, the slab storage keeps elements
+     * inside of it's own pages.
+     */
+
+    // Removes the element from the list without destroying it, the caller must delete it
+    T* release(size_t at)
     {
-        size_t i = 0, moveTo = m_size;
-        for(; i < m_size; i++)
-        {
-            if(*m_data[i] == item)
-            {
-                delete m_data[i];
-                if(moveTo == m_size)
-                    moveTo = i;
-                continue;
-            }
-            if(moveTo != m_size)
-                m_data[moveTo++] = m_data[i];
-        }
-        m_size -= (i - moveTo);
-        m_data[m_size] = nullptr;
+        static_assert(Storage::transferable, "Elements of this storage can't leave the list");
+        settle(&at);
+        assert(m_size > at);
+        T* p = releaseItem(m_data[at]);
+        dropSlots(at, 1);
+        return p;
     }
 
-    iterator erase(iterator pos)
+    std::unique_ptr<T> takeAt(size_t at)
     {
-        assert(pos.m_pos <= m_size);
-        removeAt(pos.m_pos, 1);
-        return iterator(m_data, pos.m_pos);
+        return std::unique_ptr<T>(release(at));
     }
 
-    iterator erase(iterator from, iterator to)
+    // Appends the element created by new, the list owns it since now
+    void adopt(T* p)
     {
-        assert(from.m_pos <= m_size);
-        assert(to.m_pos <= m_size);
-        assert(to.m_pos >= from.m_pos);
-        if(from == to)
-            return from;
-        removeAt(from.m_pos, to.m_pos - from.m_pos);
-        return iterator(m_data, from.m_pos);
+        static_assert(Storage::transferable, "This storage can't take foreign elements");
+        assert(p);
+        adoptItem(p);
+        appendItem(p);
     }
 
-    void removeAt(size_t at)
+    void adopt(size_t at, T* p)
     {
-        assert(m_size > 0);
-        size_t i = at + 1, moveTo = at;
-        delete m_data[at];
-        for(; i < m_size; i++)
-        {
-            if(moveTo == m_size)
-                break;
-            m_data[moveTo++] = m_data[i];
-        }
-        m_size--;
-        m_data[m_size] = nullptr;
+        static_assert(Storage::transferable, "This storage can't take foreign elements");
+        assert(p);
+        adoptItem(p);
+        insertItem(at, p);
     }
 
-    void removeAt(size_t at, size_t num)
+    void adopt(std::unique_ptr<T>&& p)
     {
-        assert(m_size > 0);
-        assert(m_size >= at + num);
-        size_t i = at, del_to = (at + num), moveTo = at;
-        while(i < del_to)
-            delete m_data[i++];
-        for(; i < m_size; i++)
+        adopt(p.get());
+        p.release();
+    }
+
+    /*
+     * Moves elements [srcFirst, srcLast) of src list to the position dstPos of
+     * this list by one shift of every list. Elements are spliced inside of the
+     * same list too (dstPos is given as a position before the move).
+     */
+    void splice(size_t dstPos, PtrList& src, size_t srcFirst, size_t srcLast)
+    {
+        static_assert(Storage::transferable, "Elements of this storage can't leave the list");
+        if(&src == this)
         {
-            if(moveTo == m_size)
-                break;
-            m_data[moveTo++] = m_data[i];
+            spliceSelf(dstPos, srcFirst, srcLast);
+            return;
         }
-        m_size -= num;
-        memset(m_data + m_size, 0, sizeof(T*)*num);
+
+        src.settle(&srcFirst, &srcLast);
+        assert(srcFirst <= srcLast && srcLast <= src.m_size);
+        size_t num = srcLast - srcFirst;
+        if(num == 0)
+            return;
+
+        size_t at = openGap(dstPos, num);
+        for(size_t i = 0; i < num; i++)
+        {
+            T* p = src.releaseItem(src.m_data[srcFirst + i]);
+            adoptItem(p);
+            m_data[at + i] = p;
+        }
+        src.dropSlots(srcFirst, num);
     }
 
-    void pop_back()
+    // Moves all elements of src list to the position dstPos
+    void splice(size_t dstPos, PtrList& src)
     {
-        removeAt(m_size - 1);
+        splice(dstPos, src, 0, src.m_size);
     }
 
-    void pop_front()
+    /*
+     * Takes the pointer array allocated by malloc() with `capacity` slots, which
+     * keeps num elements created by new, in O(1) (the hash index is rebuilt).
+     * One slot after the last element is needed for the null terminator.
+     * Current elements of the list are destroyed.
+     */
+    void adoptStorage(T** data, size_t num, size_t capacity)
     {
-        removeAt(0);
+        static_assert(Storage::transferable, "This storage can't take foreign elements");
+        assert(data && capacity > num);
+        clear();
+        m_data = data;
+        m_size = num;
+        m_sizeReserved = capacity;
+        m_data[num] = nullptr;
+        reindex();
+    }
+
+    /*
+     * Gives the null terminated pointer array away in O(1) (a headroom, holes
+     * and the small buffer cost a copy of pointers), the caller must delete num
+     * elements and free() the array. Returns null when nothing was allocated.
+     * The list becomes empty.
+     */
+    T** takeStorage(size_t& num)
+    {
+        static_assert(Storage::transferable, "Elements of this storage can't leave the list");
+        settle();
+        if(m_head > 0)
+        {
+            memmove(m_data - m_head, m_data, sizeof(T*) * (m_size + 1));
+            countShifts(m_size);
+            m_data -= m_head;
+            m_head = 0;
+        }
+        T** data = m_data;
+        if(isInline())
+        {
+            data = (T**)malloc(sizeof(T*) * (m_size + 1));
+            if(!data)
+                throw std::bad_alloc();
+            memcpy(data, m_data, sizeof(T*) * (m_size + 1));
+        }
+        if(m_extra && m_extra->index)
+            m_extra->index->clear();
+        if(m_extra && m_extra->positions)
+            m_extra->positions->clear();
+        num = m_size;
+        m_data = nullptr;
+        m_size = 0;
+        m_sizeReserved = 0;
+        return data;
     }
 
     void swap(size_t from, size_t to)
@@ -364,110 +1839,284 @@ public:
         T* tmp       = m_data[from];
         m_data[from] = m_data[to];
         m_data[to]   = tmp;
+        if(m_extra && m_extra->index)
+            m_extra->index->swapped(m_data[from], from, m_data[to], to);
+        if(m_extra && m_extra->positions)
+            m_extra->positions->swapped(m_data[from], from, m_data[to], to);
     }
 
     void move(size_t from, size_t to)
     {
+        settle(&from, &to);
         assert(m_size > from);
         assert(m_size > to);
         if(from == to)
             return;
+        shifted(from < to ? from : to);
+        countShifts(from < to ? to - from : from - to);
+        T* it = m_data[from];
         if(from < to)
-        {
-            T* it = m_data[from];
-            while(from < to)
-            {
-                m_data[from] = m_data[from+1];
-                from++;
-            }
-            m_data[to] = it;
-        } else {
-            T* it = m_data[from];
-            while(from > to)
-            {
-                m_data[from] = m_data[from-1];
-                from--;
-            }
-            m_data[to] = it;
-        }
+            memmove(m_data + from, m_data + from + 1, sizeof(T*) * (to - from));
+        else
+            memmove(m_data + to + 1, m_data + to, sizeof(T*) * (from - to));
+        m_data[to] = it;
+    }
+
+    /*
+     * Sorting: only pointers get permuted, elements are never moved,
+     * so external pointers to them are still valid
+     */
+    template<class Compare>
+    void sort(Compare cmp)
+    {
+        settle();
+        std::sort(m_data, m_data + m_size, [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void sort()
+    {
+        sort(std::less<T>());
+    }
+
+    template<class Compare>
+    void stable_sort(Compare cmp)
+    {
+        settle();
+        std::stable_sort(m_data, m_data + m_size, [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void stable_sort()
+    {
+        stable_sort(std::less<T>());
+    }
+
+    /*
+     * Stable sort on multiple threads, gives the same result as stable_sort().
+     * threads = 0 uses all hardware threads, lists with less than `threshold`
+     * elements per thread are sorted on the calling thread.
+     * Comparator must not throw and must be safe to call from multiple threads.
+     */
+    template<class Compare>
+    void parallel_sort(Compare cmp, unsigned threads = 0,
+                       size_t threshold = PtrListSort::defaultParallelThreshold)
+    {
+        settle();
+        PtrListSort::parallelStable(m_data, m_size, [cmp](const T* a, const T* b) { return cmp(*a, *b); },
+                                    threads, threshold);
+        shifted(0);
+    }
+
+    void parallel_sort()
+    {
+        parallel_sort(std::less<T>());
+    }
+
+    /*
+     * Stable sort by the key returned by keyFn(const T&): keys are taken once
+     * into a contiguous array, and integral or floating point keys are sorted
+     * by the radix sort, so elements are not dereferenced while sorting
+     */
+    template<class KeyFn>
+    void sortByKey(KeyFn keyFn)
+    {
+        settle();
+        PtrListSort::byKey(m_data, m_size, [&keyFn](const T* p) { return keyFn(*p); });
+        shifted(0);
+    }
+
+    // Sorts the first `middle` elements, rest of elements are in unspecified order
+    template<class Compare>
+    void partial_sort(size_t middle, Compare cmp)
+    {
+        settle();
+        assert(middle <= m_size);
+        std::partial_sort(m_data, m_data + middle, m_data + m_size, [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void partial_sort(size_t middle)
+    {
+        partial_sort(middle, std::less<T>());
+    }
+
+    // Puts to the nth position the element which would be there in a sorted list
+    template<class Compare>
+    void nth_element(size_t nth, Compare cmp)
+    {
+        settle();
+        assert(nth < m_size);
+        std::nth_element(m_data, m_data + nth, m_data + m_size, [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void nth_element(size_t nth)
+    {
+        nth_element(nth, std::less<T>());
     }
 
     void push_back(const T& item)
     {
-        if((m_size + 1) >= m_sizeReserved)
-            reserve(4);
-        m_data[m_size] = new T(item);
-        m_size++;
-        m_data[m_size] = nullptr;
+        appendItem(createItem(item));
+    }
+
+    void push_back(T&& item)
+    {
+        appendItem(createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        appendItem(createItem(std::forward<Args>(args)...));
     }
 
     void push_front(const T& item)
     {
-        insert(0, item);
+        insertItem(0, createItem(item));
+    }
+
+    void push_front(T&& item)
+    {
+        insertItem(0, createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace_front(Args&&... args)
+    {
+        insertItem(0, createItem(std::forward<Args>(args)...));
     }
 
     void append(const T& item)
     {
-        if( (m_size + 1) >= m_sizeReserved)
-            reserve(4);
-        m_data[m_size] = new T(item);
-        m_size++;
-        m_data[m_size] = nullptr;
+        appendItem(createItem(item));
+    }
+
+    void append(T&& item)
+    {
+        appendItem(createItem(std::move(item)));
+    }
+
+    void append(const PtrList &array)
+    {
+        insert(m_size, array);
+    }
+
+    // Elements of other list are handed over (moved into new elements with the slab storage), other list becomes empty
+    void append(PtrList &&array)
+    {
+        insert(m_size, std::move(array));
+    }
+
+    template<class InputIt, class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void append(InputIt first, InputIt last)
+    {
+        insert(m_size, first, last);
     }
 
-    void append(const PtrList<T> &array)
+    void append(std::initializer_list<T> il)
     {
-        reserve(array.size());
-        for(const T& t : array)
-            this->push_back(t);
+        insertRange(m_size, il.size(), il.begin());
     }
 
     void insert(size_t at, const T& item)
     {
-        if(at >= m_size)
-            at = m_size;
-        if((m_size+1) >= m_sizeReserved)
-            reserve(4);
-        if(at < m_size)
+        insertItem(at, createItem(item));
+    }
+
+    void insert(size_t at, T&& item)
+    {
+        insertItem(at, createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace(size_t at, Args&&... args)
+    {
+        insertItem(at, createItem(std::forward<Args>(args)...));
+    }
+
+    /*
+     * Range insertions: the pointer array is grown once, the tail (or the
+     * front part) is shifted once, then elements are created in one pass
+     */
+
+    // Iterators must be at least forward ones and must not point into this list
+    template<class InputIt, class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void insert(size_t at, InputIt first, InputIt last)
+    {
+        insertRange(at, size_t(std::distance(first, last)), first);
+    }
+
+    void insert(size_t at, std::initializer_list<T> il)
+    {
+        insertRange(at, il.size(), il.begin());
+    }
+
+    void insert(size_t at, const PtrList &array)
+    {
+        if(this == &array)
         {
-            unsigned int insertAt = m_size;
-            do{
-                insertAt--;
-                m_data[insertAt+1] = m_data[insertAt];
-            }while(insertAt > at);
+            insert(at, PtrList(array));
+            return;
         }
-        m_data[at] = new T(item);
-        m_size++;
-        m_data[m_size] = nullptr;
+        insertRange(at, array.m_size - array.m_removed, array.begin());
+    }
+
+    // Elements of other list are handed over (moved into new elements with the slab storage), other list becomes empty.
+    // The list itself can't hand it's elements over to itself, so they are copied like by the const overload.
+    void insert(size_t at, PtrList &&array)
+    {
+        if(this == &array)
+        {
+            insert(at, static_cast<const PtrList&>(array));
+            return;
+        }
+        insertMoved(at, array, std::integral_constant<bool, Storage::transferable>());
+        array.clear();
     }
 
+    // Holes are skipped, but not closed, so these are safe while walking the list
     T& last()
     {
-        assert(m_size > 0);
-        return *(m_data[m_size-1]);
+        assert(m_size > m_removed);
+        return *(m_data[lastLive()]);
     }
 
     T& back()
     {
-        assert(m_size > 0);
-        return *(m_data[m_size-1]);
+        assert(m_size > m_removed);
+        return *(m_data[lastLive()]);
     }
 
     T& first()
     {
-        assert(m_size > 0);
-        return *(m_data[0]);
+        assert(m_size > m_removed);
+        return *(m_data[firstLive()]);
     }
 
     T& front()
     {
-        assert(m_size>0);
-        return *(m_data[0]);
+        assert(m_size > m_removed);
+        return *(m_data[firstLive()]);
+    }
+
+    Storage& storage()
+    {
+        return elementStorage();
+    }
+
+    const T &operator[](size_t index) const
+    {
+        assert(index < m_size);
+        assert(m_data[index] != tombstone());
+        return *(m_data[index]);
     }
 
     T &operator[](unsigned int index)
     {
         assert(index < (unsigned int)(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
@@ -475,12 +2124,14 @@ public:
     {
         assert(index >= 0);
         assert(index < int(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
     T &operator[](unsigned long index)
     {
         assert(index < (unsigned long)(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
@@ -488,12 +2139,14 @@ public:
     {
         assert(index >= 0);
         assert(index < long(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
     T &operator[](unsigned long long index)
     {
         assert(index < (unsigned long long)(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
@@ -501,23 +2154,32 @@ public:
     {
         assert(index >= 0);
         assert(index < (long long)(m_size));
+        assert(m_data[index] != tombstone());
         return *(m_data[index]);
     }
 
-    bool operator==(const PtrList<T>& o2)
+    bool operator==(const PtrList& o2)
     {
-        if(m_size != o2.m_size)
+        settle();
+        if(m_size != o2.m_size - o2.m_removed)
             return false;
-        for(int i=0; i<m_size; i++)
-            if( (*m_data[i]) != (*o2.m_data[i]))
+        size_t i = 0;
+        for(const T& t : o2)
+        {
+            if( (*m_data[i++]) != t)
                 return false;
+        }
         return true;
     }
 
-    bool operator!=(const PtrList<T>& o2)
+    bool operator!=(const PtrList& o2)
     {
         return !operator==(o2);
     }
 };
 
+// List which keeps up to N pointers inside of itself
+template<class T, size_t N, class Storage = PtrListHeapStorage<T>, class Growth = PtrListGeometricGrowth>
+using SmallPtrList = PtrList<T, Storage, Growth, N>;
+
 #endif // PTRLIST_H
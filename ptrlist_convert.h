@@ -0,0 +1,80 @@
+/*
+PtrListConvert - conversions between PtrList and VPtrList without copying of elements
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PTRLIST_CONVERT_H
+#define PTRLIST_CONVERT_H
+
+#include <memory>
+#include <new>
+#include <utility>
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "ptrlist.h"
+#include "vptrlist.h"
+
+/*
+ * Elements are handed over from one list to another as they are, so they keep
+ * their addresses, only their pointers are copied (O(n) pointers). The source
+ * list becomes empty. PtrList must have the heap storage, and VPtrList must
+ * have the default allocator: both of them create elements by new.
+ */
+
+template<class T, class Storage, class Growth, size_t InlineSlots>
+VPtrList<T> toVPtrList(PtrList<T, Storage, Growth, InlineSlots> &&list)
+{
+    typename VPtrList<T>::vecPTR items;
+    items.reserve(list.size());
+
+    size_t num = 0;
+    T **data = list.takeStorage(num);
+    for(size_t i = 0; i < num; i++)
+        items.emplace_back(data[i]);
+    free(data);
+
+    return VPtrList<T>(std::move(items));
+}
+
+template<class T, class Storage = PtrListHeapStorage<T>, class Growth = PtrListGeometricGrowth>
+PtrList<T, Storage, Growth> toPtrList(VPtrList<T> &&list)
+{
+    typename VPtrList<T>::vecPTR items = list.takeStorage();
+    size_t num = items.size();
+    T **data = (T**)malloc(sizeof(T*) * (num + 1));
+    if(!data)
+    {
+        // Elements stay owned by the list
+        list = VPtrList<T>(std::move(items));
+        throw std::bad_alloc();
+    }
+
+    for(size_t i = 0; i < num; i++)
+        data[i] = items[i].release();
+
+    PtrList<T, Storage, Growth> ret;
+    ret.adoptStorage(data, num, num + 1);
+    return ret;
+}
+
+#endif // PTRLIST_CONVERT_H
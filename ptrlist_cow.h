@@ -0,0 +1,137 @@
+/*
+PtrListCow - copy-on-write sharing of PtrList, VPtrList or SegPtrList
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PTRLIST_COW_H
+#define PTRLIST_COW_H
+
+#include <memory>
+#include <utility>
+#include <stddef.h>
+
+/*
+ * Holds a list which is shared by all copies of the holder through a
+ * reference count, so copying of the holder is O(1). The list is read by
+ * read() (or * and ->), and edit() makes a private deep copy of it first if
+ * it's still shared with others, so only holders which get written pay for
+ * the copying.
+ *
+ * Elements of a detached list are new objects: pointers to elements taken
+ * from the shared list keep pointing to the list of other holders.
+ *
+ * The reference count is atomic, so holders of the same list can live in
+ * different threads, but every holder must be used by one thread at a time.
+ * Lists must be only walked and accessed by position while they are shared
+ * between threads: lookups fill the mutable position cache of the index.
+ */
+template<class List>
+class PtrListCow
+{
+    std::shared_ptr<List> m_list;
+
+public:
+    typedef List                        list_type;
+    typedef typename List::value_type   value_type;
+
+    PtrListCow() :
+        m_list(std::make_shared<List>())
+    {}
+
+    explicit PtrListCow(const List &list) :
+        m_list(std::make_shared<List>(list))
+    {}
+
+    explicit PtrListCow(List &&list) :
+        m_list(std::make_shared<List>(std::move(list)))
+    {}
+
+    PtrListCow(const PtrListCow &) = default;
+    PtrListCow &operator=(const PtrListCow &) = default;
+
+    // Moved holder gets a new empty list
+    PtrListCow(PtrListCow &&o) :
+        m_list(std::move(o.m_list))
+    {
+        o.m_list = std::make_shared<List>();
+    }
+
+    PtrListCow &operator=(PtrListCow &&o)
+    {
+        if(this != &o)
+        {
+            m_list = std::move(o.m_list);
+            o.m_list = std::make_shared<List>();
+        }
+        return *this;
+    }
+
+    const List &read() const
+    {
+        return *m_list;
+    }
+
+    const List &operator*() const
+    {
+        return *m_list;
+    }
+
+    const List *operator->() const
+    {
+        return m_list.get();
+    }
+
+    // Detaches the list from other holders if it's shared, references taken by read() before keep pointing to their list
+    List &edit()
+    {
+        detach();
+        return *m_list;
+    }
+
+    void detach()
+    {
+        if(m_list.use_count() > 1)
+            m_list = std::make_shared<List>(*m_list);
+    }
+
+    bool isShared() const
+    {
+        return m_list.use_count() > 1;
+    }
+
+    long useCount() const
+    {
+        return m_list.use_count();
+    }
+
+    size_t size() const
+    {
+        return m_list->size();
+    }
+
+    void swap(PtrListCow &o)
+    {
+        m_list.swap(o.m_list);
+    }
+};
+
+#endif // PTRLIST_COW_H
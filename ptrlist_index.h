@@ -0,0 +1,411 @@
+/*
+PtrListIndex - optional hash index of PtrList and VPtrList elements
+which allows to find elements by their content without walking the whole list
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PTRLIST_INDEX_H
+#define PTRLIST_INDEX_H
+
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+
+#if defined(__EMSCRIPTEN__) || !defined(_WIN32)
+#include <sys/types.h>
+#endif
+
+#ifdef _MSC_VER
+#ifdef _WIN64
+typedef long long ssize_t;
+#else
+typedef int ssize_t;
+#endif
+#endif
+
+// Hashes the element itself by the std::hash<T>
+template<class T>
+struct PtrListValueHasher
+{
+    size_t operator()(const T &v) const
+    {
+        return std::hash<T>()(v);
+    }
+};
+
+// Hashes the key taken from the element by the user function
+template<class T, class KeyFn>
+struct PtrListKeyHasher
+{
+    typedef typename std::decay<decltype(std::declval<KeyFn>()(std::declval<const T&>()))>::type Key;
+    KeyFn key;
+
+    explicit PtrListKeyHasher(const KeyFn &k) : key(k) {}
+
+    size_t operator()(const T &v) const
+    {
+        return std::hash<Key>()(key(v));
+    }
+};
+
+/*
+ * Reverse index: address of an element -> it's slot in the list.
+ *
+ * Every entry keeps the slot of the element and the count of shifts which were
+ * applied to it. Insertions and removals by position don't touch entries, they
+ * append a shift (all slots from `from` are moved by `delta`), and a lookup
+ * applies shifts which happened after it's entry was updated. When shifts get
+ * more than the square root of the size, the index is dropped and gets rebuilt
+ * by the next lookup. So an insertion or a removal costs amortised O(sqrt n) of
+ * the index work, and a lookup is O(sqrt n) at worst and O(1) when the list is
+ * mostly read.
+ *
+ * Slots [0, m_known) are all indexed. Elements after them (appended ones, or
+ * reordered by sorting, move() and compaction) are indexed by the next lookup
+ * which misses, elements inserted into the indexed part are looked up by the
+ * linear pass over pointers until the next rebuild.
+ */
+template<class T>
+class PtrListPositions
+{
+    struct Entry
+    {
+        size_t pos;
+        size_t shifts;
+    };
+
+    struct Shift
+    {
+        size_t from;
+        ptrdiff_t delta;
+    };
+
+    typedef std::unordered_map<const T*, Entry> PositionsMap;
+
+    mutable PositionsMap m_positions;
+    std::vector<Shift>  m_shifts;
+    mutable size_t  m_known;
+    // Some of elements before m_known aren't indexed
+    mutable bool    m_gaps;
+    // Count of shifts which makes to drop the index
+    mutable size_t  m_maxShifts;
+    // Work done by lookups: slots indexed or scanned and shifts applied
+    mutable size_t  m_visits;
+
+    static const T *rawPtr(const T *p)
+    {
+        return p;
+    }
+
+    template<class D>
+    static const T *rawPtr(const std::unique_ptr<T, D> &p)
+    {
+        return p.get();
+    }
+
+    void shiftedBy(size_t from, ptrdiff_t delta)
+    {
+        if(m_positions.empty())
+            return;
+        Shift sh = {from, delta};
+        m_shifts.push_back(sh);
+        if(m_shifts.size() > m_maxShifts)
+            clear();
+    }
+
+    template<class Ptr>
+    void indexTail(const Ptr *data, size_t size) const
+    {
+        size_t stamp = m_shifts.size();
+        m_visits += size - m_known;
+        for(size_t i = m_known; i < size; i++)
+        {
+            Entry e = {i, stamp};
+            m_positions[rawPtr(data[i])] = e;
+        }
+        m_known = size;
+
+        size_t root = 1;
+        while(root * root < size)
+            root++;
+        m_maxShifts = root > 16 ? root : 16;
+    }
+
+    // Current slot of the entry, or the size if it's outdated
+    template<class Ptr>
+    size_t actual(const T *p, const Ptr *data, size_t size) const
+    {
+        typename PositionsMap::iterator it = m_positions.find(p);
+        if(it == m_positions.end())
+            return size;
+        Entry &e = it->second;
+        m_visits += m_shifts.size() - e.shifts;
+        for(; e.shifts < m_shifts.size(); e.shifts++)
+        {
+            const Shift &sh = m_shifts[e.shifts];
+            if(e.pos >= sh.from)
+                e.pos = size_t(ptrdiff_t(e.pos) + sh.delta);
+        }
+        if(e.pos < size && rawPtr(data[e.pos]) == p)
+            return e.pos;
+        return size;
+    }
+
+public:
+    PtrListPositions() :
+        m_known(0),
+        m_gaps(false),
+        m_maxShifts(16),
+        m_visits(0)
+    {}
+
+    // Content is never copied, it gets rebuilt by the first query
+    PtrListPositions(const PtrListPositions &) :
+        m_known(0),
+        m_gaps(false),
+        m_maxShifts(16),
+        m_visits(0)
+    {}
+
+    PtrListPositions &operator=(const PtrListPositions &) = delete;
+
+    void clear()
+    {
+        m_positions.clear();
+        m_shifts.clear();
+        m_known = 0;
+        m_gaps = false;
+    }
+
+    size_t visits() const
+    {
+        return m_visits;
+    }
+
+    // Must be called before the element will be destroyed
+    void removed(const T *p)
+    {
+        m_positions.erase(p);
+    }
+
+    // num slots were inserted at the given slot, elements after them are moved
+    void inserted(size_t at, size_t num)
+    {
+        if(at < m_known)
+        {
+            m_known += num;
+            m_gaps = true;
+        }
+        shiftedBy(at, ptrdiff_t(num));
+    }
+
+    // num slots were removed at the given slot, elements after them are moved
+    void erased(size_t at, size_t num)
+    {
+        if(at + num <= m_known)
+            m_known -= num;
+        else if(at < m_known)
+            m_known = at;
+        shiftedBy(at + num, -ptrdiff_t(num));
+    }
+
+    // Elements at this slot and after it were reordered
+    void shifted(size_t from)
+    {
+        if(from < m_known)
+            m_known = from;
+    }
+
+    // Two elements have exchanged their slots
+    void swapped(const T *a, size_t aPos, const T *b, size_t bPos)
+    {
+        Entry ea = {aPos, m_shifts.size()}, eb = {bPos, m_shifts.size()};
+        m_positions[a] = ea;
+        m_positions[b] = eb;
+    }
+
+    // Returns the slot of the element, or the size if it's not in the list
+    template<class Ptr>
+    size_t position(const T *p, const Ptr *data, size_t size) const
+    {
+        size_t at = actual(p, data, size);
+        if(at < size)
+            return at;
+
+        if(m_known > size)
+            m_known = size;
+        if(m_known < size)
+        {
+            indexTail(data, size);
+            at = actual(p, data, size);
+            if(at < size)
+                return at;
+        }
+
+        if(m_gaps)
+        {
+            for(size_t i = 0; i < size; i++)
+            {
+                if(rawPtr(data[i]) == p)
+                {
+                    m_visits += i + 1;
+                    Entry e = {i, m_shifts.size()};
+                    m_positions[p] = e;
+                    return i;
+                }
+            }
+            m_visits += size;
+        }
+        return size;
+    }
+};
+
+/*
+ * Elements are stored by hash of their content (a hash collision is resolved by
+ * the operator==), so the contains() check is O(1). Positions of found elements
+ * are taken from the PtrListPositions, so indexOf() is amortised O(1) too.
+ *
+ * Elements must not change their hashed content while they are in the list,
+ * otherwise the list must be reindexed.
+ */
+template<class T>
+class PtrListIndex
+{
+public:
+    typedef std::function<size_t(const T&)> Hasher;
+
+private:
+    typedef std::unordered_multimap<size_t, const T*>   ItemsMap;
+
+    Hasher          m_hasher;
+    ItemsMap        m_items;
+    PtrListPositions<T> m_positions;
+
+public:
+    explicit PtrListIndex(const Hasher &hasher) :
+        m_hasher(hasher)
+    {}
+
+    // Copies the hashing setup only, the content gets filled by the list
+    PtrListIndex(const PtrListIndex &o) :
+        m_hasher(o.m_hasher)
+    {}
+
+    PtrListIndex &operator=(const PtrListIndex &) = delete;
+
+    void clear()
+    {
+        m_items.clear();
+        m_positions.clear();
+    }
+
+    void reserve(size_t num)
+    {
+        m_items.reserve(num);
+    }
+
+    // Must be called after the element has been stored into the list
+    void added(const T *p)
+    {
+        m_items.insert(std::make_pair(m_hasher(*p), p));
+    }
+
+    // Must be called before the element will be destroyed
+    void removed(const T *p)
+    {
+        std::pair<typename ItemsMap::iterator, typename ItemsMap::iterator> r = m_items.equal_range(m_hasher(*p));
+        for(typename ItemsMap::iterator it = r.first; it != r.second; ++it)
+        {
+            if(it->second == p)
+            {
+                m_items.erase(it);
+                break;
+            }
+        }
+        m_positions.removed(p);
+    }
+
+    void inserted(size_t at, size_t num)
+    {
+        m_positions.inserted(at, num);
+    }
+
+    void erased(size_t at, size_t num)
+    {
+        m_positions.erased(at, num);
+    }
+
+    void shifted(size_t from)
+    {
+        m_positions.shifted(from);
+    }
+
+    void swapped(const T *a, size_t aPos, const T *b, size_t bPos)
+    {
+        m_positions.swapped(a, aPos, b, bPos);
+    }
+
+    size_t visits() const
+    {
+        return m_positions.visits();
+    }
+
+    // Slot of the element by it's address, or the size if it's not in the list
+    template<class Ptr>
+    size_t position(const T *p, const Ptr *data, size_t size) const
+    {
+        return m_positions.position(p, data, size);
+    }
+
+    bool contains(const T &item) const
+    {
+        std::pair<typename ItemsMap::const_iterator, typename ItemsMap::const_iterator> r = m_items.equal_range(m_hasher(item));
+        for(typename ItemsMap::const_iterator it = r.first; it != r.second; ++it)
+        {
+            if(*it->second == item)
+                return true;
+        }
+        return false;
+    }
+
+    template<class Ptr>
+    ssize_t indexOf(const T &item, const Ptr *data, size_t size, bool last = false) const
+    {
+        std::pair<typename ItemsMap::const_iterator, typename ItemsMap::const_iterator> r = m_items.equal_range(m_hasher(item));
+        ssize_t found = -1;
+        for(typename ItemsMap::const_iterator it = r.first; it != r.second; ++it)
+        {
+            if(!(*it->second == item))
+                continue;
+            ssize_t pos = ssize_t(m_positions.position(it->second, data, size));
+            if(found < 0 || (last ? pos > found : pos < found))
+                found = pos;
+        }
+        return found;
+    }
+};
+
+#endif // PTRLIST_INDEX_H
@@ -0,0 +1,368 @@
+/*
+PtrListSort - sorting algorithms over the pointer arrays of PtrList and VPtrList
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PTRLIST_SORT_H
+#define PTRLIST_SORT_H
+
+#include <algorithm>
+#include <exception>
+#include <iterator>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Maps keys into unsigned integers with the same order,
+ * which allows to sort them by the radix sort.
+ *
+ * Floating point keys: -0.0 and +0.0 are equal (they keep their order like
+ * by the stable sort), and all NaNs are equal to each other and go after
+ * all other keys, including the +infinity.
+ */
+template<class Key, class Enable = void>
+struct PtrListRadixTraits
+{
+    static const bool radix = false;
+};
+
+template<class Key>
+struct PtrListRadixTraits<Key, typename std::enable_if<std::is_integral<Key>::value &&
+                                                       !std::is_same<Key, bool>::value>::type>
+{
+    static const bool radix = true;
+    typedef typename std::make_unsigned<Key>::type Bits;
+
+    static Bits toBits(Key k)
+    {
+        Bits b = Bits(k);
+        if(std::is_signed<Key>::value)
+            b ^= Bits(Bits(1) << (sizeof(Bits) * 8 - 1));
+        return b;
+    }
+};
+
+template<>
+struct PtrListRadixTraits<float, void>
+{
+    static const bool radix = true;
+    typedef uint32_t Bits;
+
+    static Bits toBits(float k)
+    {
+        if(k == 0.0f)
+            k = 0.0f;
+        else if(k != k)
+            return ~Bits(0);
+        Bits b;
+        memcpy(&b, &k, sizeof(b));
+        return (b & 0x80000000u) ? ~b : (b | 0x80000000u);
+    }
+};
+
+template<>
+struct PtrListRadixTraits<double, void>
+{
+    static const bool radix = true;
+    typedef uint64_t Bits;
+
+    static Bits toBits(double k)
+    {
+        if(k == 0.0)
+            k = 0.0;
+        else if(k != k)
+            return ~Bits(0);
+        Bits b;
+        memcpy(&b, &k, sizeof(b));
+        return (b & 0x8000000000000000ull) ? ~b : (b | 0x8000000000000000ull);
+    }
+};
+
+/*
+ * Copies of elements are created on multiple threads by clone() only when the
+ * copy constructor of T is safe to be called concurrently (it doesn't touch any
+ * shared state besides of the thread-safe memory allocation). It's assumed for
+ * trivially copyable types only, specialise it for other types:
+ *
+ *     template<> struct PtrListThreadSafeCopy<MyType> : std::true_type {};
+ */
+template<class T>
+struct PtrListThreadSafeCopy : std::integral_constant<bool, std::is_trivially_copyable<T>::value>
+{};
+
+struct PtrListParallel
+{
+    // Lists smaller than this count of elements per thread are cloned sequentially
+    static const size_t defaultCopyThreshold = 8192;
+
+    // Count of threads for n items, threads = 0 means all hardware threads
+    static unsigned threadsFor(size_t n, unsigned threads, size_t threshold)
+    {
+        if(threads == 0)
+            threads = std::thread::hardware_concurrency();
+        if(threshold == 0)
+            threshold = 1;
+        if(threads > n / threshold)
+            threads = unsigned(n / threshold);
+        return threads < 1 ? 1 : threads;
+    }
+
+    /*
+     * Calls job(begin, end) for `threads` equal chunks of [0, n), the first
+     * chunk is done by the calling thread. When jobs throw, the first exception
+     * is rethrown after all threads are joined.
+     */
+    template<class Job>
+    static void forChunks(size_t n, unsigned threads, Job job)
+    {
+        if(threads < 2)
+        {
+            job(size_t(0), n);
+            return;
+        }
+
+        std::vector<std::exception_ptr> errors(threads);
+        std::vector<std::thread> workers;
+        workers.reserve(threads - 1);
+        for(size_t i = 1; i < threads; i++)
+        {
+            size_t b = (n * i) / threads, e = (n * (i + 1)) / threads;
+            std::exception_ptr *error = &errors[i];
+            workers.push_back(std::thread([b, e, error, &job]()
+            {
+                try
+                {
+                    job(b, e);
+                }
+                catch(...)
+                {
+                    *error = std::current_exception();
+                }
+            }));
+        }
+
+        try
+        {
+            job(size_t(0), n / threads);
+        }
+        catch(...)
+        {
+            errors[0] = std::current_exception();
+        }
+
+        for(std::thread &t : workers)
+            t.join();
+        for(std::exception_ptr &e : errors)
+        {
+            if(e)
+                std::rethrow_exception(e);
+        }
+    }
+};
+
+struct PtrListSort
+{
+    // Lists smaller than this count of elements per thread are sorted sequentially
+    static const size_t defaultParallelThreshold = 32768;
+
+    /*
+     * Stable merge sort on multiple threads: every thread sorts it's chunk by
+     * std::stable_sort, then chunks are merged by pairs in parallel, with the
+     * left chunk winning the ties. So the result is identical to std::stable_sort.
+     *
+     * The comparator gets copied into every thread and must not throw.
+     */
+    template<class Slot, class Compare>
+    static void parallelStable(Slot *data, size_t n, Compare cmp,
+                               unsigned threads = 0,
+                               size_t threshold = defaultParallelThreshold)
+    {
+        threads = PtrListParallel::threadsFor(n, threads, threshold);
+        if(threads < 2)
+        {
+            std::stable_sort(data, data + n, cmp);
+            return;
+        }
+
+        std::vector<size_t> bounds(threads + 1);
+        for(size_t i = 0; i <= threads; i++)
+            bounds[i] = (n * i) / threads;
+
+        {
+            std::vector<std::thread> workers;
+            workers.reserve(threads - 1);
+            for(size_t i = 1; i < threads; i++)
+            {
+                Slot *b = data + bounds[i], *e = data + bounds[i + 1];
+                workers.push_back(std::thread([b, e, cmp]() { std::stable_sort(b, e, cmp); }));
+            }
+            std::stable_sort(data, data + bounds[1], cmp);
+            for(std::thread &t : workers)
+                t.join();
+        }
+
+        std::vector<Slot> buffer(n);
+        Slot *src = data, *dst = buffer.data();
+
+        while(bounds.size() > 2)
+        {
+            std::vector<size_t> next;
+            std::vector<std::thread> workers;
+            size_t i = 0;
+
+            for(; i + 2 < bounds.size(); i += 2)
+            {
+                Slot *a = src + bounds[i], *m = src + bounds[i + 1], *e = src + bounds[i + 2];
+                Slot *out = dst + bounds[i];
+                workers.push_back(std::thread([a, m, e, out, cmp]()
+                {
+                    std::merge(std::make_move_iterator(a), std::make_move_iterator(m),
+                               std::make_move_iterator(m), std::make_move_iterator(e),
+                               out, cmp);
+                }));
+                next.push_back(bounds[i]);
+            }
+
+            // Odd chunk at the end has no pair at this round
+            if(i + 1 < bounds.size())
+            {
+                std::move(src + bounds[i], src + bounds[i + 1], dst + bounds[i]);
+                next.push_back(bounds[i]);
+            }
+            next.push_back(n);
+
+            for(std::thread &t : workers)
+                t.join();
+
+            std::swap(src, dst);
+            bounds.swap(next);
+        }
+
+        if(src != data)
+            std::move(src, src + n, data);
+    }
+
+    /*
+     * Stable sort by the key: keys are taken from every element once into the
+     * contiguous array together with the slot number, so the sorting doesn't
+     * dereference element pointers at all. Integral and floating point keys
+     * are sorted by the LSD radix sort, other keys by std::stable_sort.
+     * Slots are moved into their new places at the end.
+     */
+    template<class Slot, class KeyOf>
+    static void byKey(Slot *data, size_t n, KeyOf keyOf)
+    {
+        typedef typename std::decay<decltype(keyOf(*data))>::type Key;
+        if(n < 2)
+            return;
+        byKey<Key>(data, n, keyOf, std::integral_constant<bool, PtrListRadixTraits<Key>::radix>());
+    }
+
+private:
+    // Small arrays aren't worth of the 256-buckets histograms
+    static const size_t radixThreshold = 256;
+
+    template<class Slot, class Item>
+    static void applyOrder(Slot *data, const std::vector<Item> &items)
+    {
+        std::vector<Slot> sorted(items.size());
+        for(size_t i = 0; i < items.size(); i++)
+            sorted[i] = std::move(data[items[i].index]);
+        std::move(sorted.begin(), sorted.end(), data);
+    }
+
+    template<class Key, class Slot, class KeyOf>
+    static void byKey(Slot *data, size_t n, KeyOf keyOf, std::false_type)
+    {
+        struct Item
+        {
+            Key key;
+            size_t index;
+        };
+        std::vector<Item> items;
+        items.reserve(n);
+        for(size_t i = 0; i < n; i++)
+            items.push_back(Item{keyOf(data[i]), i});
+        std::stable_sort(items.begin(), items.end(),
+                         [](const Item &a, const Item &b) { return a.key < b.key; });
+        applyOrder(data, items);
+    }
+
+    template<class Key, class Slot, class KeyOf>
+    static void byKey(Slot *data, size_t n, KeyOf keyOf, std::true_type)
+    {
+        typedef PtrListRadixTraits<Key> Traits;
+        typedef typename Traits::Bits Bits;
+        struct Item
+        {
+            Bits key;
+            size_t index;
+        };
+
+        std::vector<Item> items(n), buffer(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            items[i].key = Traits::toBits(keyOf(data[i]));
+            items[i].index = i;
+        }
+
+        if(n < radixThreshold)
+        {
+            std::stable_sort(items.begin(), items.end(),
+                             [](const Item &a, const Item &b) { return a.key < b.key; });
+        }
+        else
+        {
+            for(size_t shift = 0; shift < sizeof(Bits) * 8; shift += 8)
+            {
+                size_t counts[256] = {};
+                for(size_t i = 0; i < n; i++)
+                    counts[(items[i].key >> shift) & 0xFF]++;
+
+                // All keys have the same byte: nothing to do on this pass
+                if(counts[(items[0].key >> shift) & 0xFF] == n)
+                    continue;
+
+                size_t offset = 0;
+                for(size_t b = 0; b < 256; b++)
+                {
+                    size_t c = counts[b];
+                    counts[b] = offset;
+                    offset += c;
+                }
+
+                for(size_t i = 0; i < n; i++)
+                    buffer[counts[(items[i].key >> shift) & 0xFF]++] = items[i];
+                items.swap(buffer);
+            }
+        }
+
+        applyOrder(data, items);
+    }
+};
+
+#endif // PTRLIST_SORT_H
@@ -0,0 +1,298 @@
+/*
+PtrListStats - optional operation counters of PtrList and VPtrList
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef PTRLIST_STATS_H
+#define PTRLIST_STATS_H
+
+#include <stddef.h>
+
+#if defined(__linux__) || defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#ifdef PTRLIST_STATS
+#include <atomic>
+#endif
+
+struct PtrListStats
+{
+    // Elements created and destroyed
+    size_t allocations;
+    size_t frees;
+    // Pointer array reallocations and bytes of pointers copied by them
+    size_t reallocations;
+    size_t bytesCopied;
+    // Pointers moved to another slot by insertions, removals and move()
+    size_t shifts;
+    // Element comparisons by the linear search and the removal by value
+    size_t comparisons;
+    // Slots and shifts walked by lookups of the address index to update it's entries
+    size_t indexVisits;
+
+    PtrListStats() :
+        allocations(0),
+        frees(0),
+        reallocations(0),
+        bytesCopied(0),
+        shifts(0),
+        comparisons(0),
+        indexVisits(0)
+    {}
+};
+
+/*
+ * Memory taken by a list. The pointer array includes the slack (unused slots
+ * of capacity and headroom), the overhead is an estimate of memory taken by
+ * the allocator besides of requested blocks (padding up to the usable size and
+ * the block header).
+ */
+struct PtrListMemoryUsage
+{
+    size_t pointerArray;
+    size_t elements;
+    size_t overhead;
+    size_t slack;
+
+    PtrListMemoryUsage() :
+        pointerArray(0),
+        elements(0),
+        overhead(0),
+        slack(0)
+    {}
+
+    size_t total() const
+    {
+        return pointerArray + elements + overhead;
+    }
+
+    // Overhead of the malloc() block which was requested for `requested` bytes
+    static size_t blockOverhead(const void *block, size_t requested)
+    {
+        size_t usable = requested;
+#if defined(__linux__)
+        usable = malloc_usable_size(const_cast<void*>(block));
+#elif defined(_WIN32)
+        usable = _msize(const_cast<void*>(block));
+#else
+        (void)block;
+#endif
+        // Block header of the most of allocators
+        return (usable > requested ? usable - requested : 0) + sizeof(size_t);
+    }
+};
+
+/*
+ * Counters are compiled in only when the PTRLIST_STATS macro is defined before
+ * including the list headers (it must be the same for the whole program).
+ * Otherwise this class is empty, all counting calls are no-op and get optimised
+ * out, and stats() always returns zeros (PtrList keeps the count of it's
+ * reallocations anyway, see PtrListReallocationCounters).
+ *
+ * Every list counts it's own operations, and the global counters aggregate the
+ * operations of all lists of the program, these are updated atomically.
+ */
+class PtrListCounters
+{
+#ifdef PTRLIST_STATS
+    struct Global
+    {
+        std::atomic<size_t> allocations;
+        std::atomic<size_t> frees;
+        std::atomic<size_t> reallocations;
+        std::atomic<size_t> bytesCopied;
+        std::atomic<size_t> shifts;
+        std::atomic<size_t> comparisons;
+        std::atomic<size_t> indexVisits;
+    };
+
+    // Lookups are counted by const functions too
+    mutable PtrListStats m_stats;
+
+    static Global &globalCounters()
+    {
+        // Zero-initialised as any static
+        static Global g;
+        return g;
+    }
+
+    static void add(size_t &local, std::atomic<size_t> &global, size_t n)
+    {
+        local += n;
+        global.fetch_add(n, std::memory_order_relaxed);
+    }
+#endif
+
+public:
+    PtrListStats stats() const
+    {
+#ifdef PTRLIST_STATS
+        return m_stats;
+#else
+        return PtrListStats();
+#endif
+    }
+
+    // Count of pointer array reallocations done by the list
+    size_t reallocations() const
+    {
+        return stats().reallocations;
+    }
+
+    void resetStats()
+    {
+#ifdef PTRLIST_STATS
+        m_stats = PtrListStats();
+#endif
+    }
+
+    static PtrListStats globalStats()
+    {
+        PtrListStats s;
+#ifdef PTRLIST_STATS
+        Global &g = globalCounters();
+        s.allocations = g.allocations.load(std::memory_order_relaxed);
+        s.frees = g.frees.load(std::memory_order_relaxed);
+        s.reallocations = g.reallocations.load(std::memory_order_relaxed);
+        s.bytesCopied = g.bytesCopied.load(std::memory_order_relaxed);
+        s.shifts = g.shifts.load(std::memory_order_relaxed);
+        s.comparisons = g.comparisons.load(std::memory_order_relaxed);
+        s.indexVisits = g.indexVisits.load(std::memory_order_relaxed);
+#endif
+        return s;
+    }
+
+    static void resetGlobalStats()
+    {
+#ifdef PTRLIST_STATS
+        Global &g = globalCounters();
+        g.allocations = 0;
+        g.frees = 0;
+        g.reallocations = 0;
+        g.bytesCopied = 0;
+        g.shifts = 0;
+        g.comparisons = 0;
+        g.indexVisits = 0;
+#endif
+    }
+
+protected:
+    // Counters belong to the list object, so copies and moved lists start from zeros
+    PtrListCounters() {}
+    PtrListCounters(const PtrListCounters &) {}
+    PtrListCounters &operator=(const PtrListCounters &) { return *this; }
+
+#ifdef PTRLIST_STATS
+    void countAllocations(size_t n) const
+    {
+        add(m_stats.allocations, globalCounters().allocations, n);
+    }
+
+    void countFrees(size_t n) const
+    {
+        add(m_stats.frees, globalCounters().frees, n);
+    }
+
+    void countReallocation(size_t bytesCopied) const
+    {
+        add(m_stats.reallocations, globalCounters().reallocations, 1);
+        add(m_stats.bytesCopied, globalCounters().bytesCopied, bytesCopied);
+    }
+
+    void countShifts(size_t n) const
+    {
+        add(m_stats.shifts, globalCounters().shifts, n);
+    }
+
+    void countComparisons(size_t n) const
+    {
+        add(m_stats.comparisons, globalCounters().comparisons, n);
+    }
+
+    void countIndexVisits(size_t n) const
+    {
+        add(m_stats.indexVisits, globalCounters().indexVisits, n);
+    }
+#else
+    void countAllocations(size_t) const {}
+    void countFrees(size_t) const {}
+    void countReallocation(size_t) const {}
+    void countShifts(size_t) const {}
+    void countComparisons(size_t) const {}
+    void countIndexVisits(size_t) const {}
+#endif
+};
+
+/*
+ * Counters of PtrList: reallocations of it's pointer array are rare, so they are
+ * counted even without the PTRLIST_STATS macro (one size_t per list), and are
+ * returned by reallocations() and stats().reallocations.
+ */
+class PtrListReallocationCounters : public PtrListCounters
+{
+#ifndef PTRLIST_STATS
+    size_t m_reallocations;
+#endif
+
+public:
+    PtrListStats stats() const
+    {
+        PtrListStats s = PtrListCounters::stats();
+#ifndef PTRLIST_STATS
+        s.reallocations = m_reallocations;
+#endif
+        return s;
+    }
+
+    size_t reallocations() const
+    {
+        return stats().reallocations;
+    }
+
+    void resetStats()
+    {
+        PtrListCounters::resetStats();
+#ifndef PTRLIST_STATS
+        m_reallocations = 0;
+#endif
+    }
+
+protected:
+#ifdef PTRLIST_STATS
+    PtrListReallocationCounters() {}
+    PtrListReallocationCounters(const PtrListReallocationCounters &) : PtrListCounters() {}
+#else
+    PtrListReallocationCounters() : m_reallocations(0) {}
+    PtrListReallocationCounters(const PtrListReallocationCounters &) : PtrListCounters(), m_reallocations(0) {}
+#endif
+    PtrListReallocationCounters &operator=(const PtrListReallocationCounters &) { return *this; }
+
+#ifndef PTRLIST_STATS
+    void countReallocation(size_t)
+    {
+        m_reallocations++;
+    }
+#endif
+};
+
+#endif // PTRLIST_STATS_H
@@ -0,0 +1,831 @@
+/*
+SegPtrList - A segmented variant of PtrList: pointers to elements are kept in
+blocks of about √n slots, so insertion and removal at the middle are O(√n)
+while the indexed access stays O(1)
+
+Copyright (c) 2017-2025 Vitaliy Novichkov <admin@wohlnet.ru>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the
+rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SEGPTRLIST_H
+#define SEGPTRLIST_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "ptrlist.h"
+
+/*
+ * Tiered vector of pointers: the pointer array is split into blocks of
+ * B = 2^k slots, every block is a ring buffer, and all blocks except the
+ * last one are always full. So the element i is at the block i / B, and an
+ * insertion or a removal shifts pointers inside of one block, then moves one
+ * pointer between every pair of following blocks, which is O(B + n / B).
+ * The block size is kept about √n by rebuilding the layout when the size
+ * grows or shrinks by 4 times.
+ *
+ * Elements are never moved, the storage policy is same as of PtrList.
+ */
+template<class T, class Storage = PtrListHeapStorage<T> >
+class SegPtrList : public PtrListCounters
+{
+    static const size_t minShift = 4;
+
+    // Blocks of (1 << m_shift) slots, the m_heads[k] is the slot of the first element of block k
+    std::vector<T*>     m_slots;
+    std::vector<size_t> m_heads;
+    size_t  m_size;
+    size_t  m_shift;
+    Storage m_storage;
+
+    size_t blockSize() const
+    {
+        return size_t(1) << m_shift;
+    }
+
+    size_t mask() const
+    {
+        return blockSize() - 1;
+    }
+
+    // Count of elements in the block k which isn't after the last one
+    size_t blockCount(size_t k) const
+    {
+        size_t first = k << m_shift;
+        return m_size - first < blockSize() ? m_size - first : blockSize();
+    }
+
+    T*& slot(size_t k, size_t pos)
+    {
+        return m_slots[(k << m_shift) + ((m_heads[k] + pos) & mask())];
+    }
+
+    T* const& slot(size_t k, size_t pos) const
+    {
+        return m_slots[(k << m_shift) + ((m_heads[k] + pos) & mask())];
+    }
+
+    T*& ptrAt(size_t i)
+    {
+        return slot(i >> m_shift, i & mask());
+    }
+
+    T* const& ptrAt(size_t i) const
+    {
+        return slot(i >> m_shift, i & mask());
+    }
+
+    template<typename... Args>
+    T* createItem(Args&&... args)
+    {
+        T* p = m_storage.create(std::forward<Args>(args)...);
+        countAllocations(1);
+        return p;
+    }
+
+    void destroyItem(T* p)
+    {
+        m_storage.destroy(p);
+        countFrees(1);
+    }
+
+    void addBlock()
+    {
+        size_t cap = m_slots.capacity();
+        m_slots.resize(m_slots.size() + blockSize(), nullptr);
+        if(m_slots.capacity() != cap)
+            countReallocation(sizeof(T*) * (m_slots.size() - blockSize()));
+        m_heads.push_back(0);
+    }
+
+    // Keeps one spare block after the last element
+    void trimBlocks()
+    {
+        size_t needed = ((m_size + blockSize() - 1) >> m_shift) + 1;
+        if(m_heads.size() > needed)
+        {
+            m_heads.resize(needed);
+            m_slots.resize(needed << m_shift);
+        }
+    }
+
+    // Inserts the pointer at position pos of block k which has count < B elements
+    void blockInsert(size_t k, size_t count, size_t pos, T* p)
+    {
+        size_t base = k << m_shift, m = mask();
+        size_t& h = m_heads[k];
+        if(pos < count - pos)
+        {
+            // Front part is shorter: shift it backward through the ring
+            h = (h - 1) & m;
+            for(size_t i = 0; i < pos; i++)
+                m_slots[base + ((h + i) & m)] = m_slots[base + ((h + i + 1) & m)];
+            countShifts(pos);
+        }
+        else
+        {
+            for(size_t i = count; i > pos; i--)
+                m_slots[base + ((h + i) & m)] = m_slots[base + ((h + i - 1) & m)];
+            countShifts(count - pos);
+        }
+        m_slots[base + ((h + pos) & m)] = p;
+    }
+
+    // Takes out the pointer at position pos of block k which has count elements
+    T* blockTake(size_t k, size_t count, size_t pos)
+    {
+        size_t base = k << m_shift, m = mask();
+        size_t& h = m_heads[k];
+        T* p = m_slots[base + ((h + pos) & m)];
+        if(pos < count - 1 - pos)
+        {
+            for(size_t i = pos; i > 0; i--)
+                m_slots[base + ((h + i) & m)] = m_slots[base + ((h + i - 1) & m)];
+            h = (h + 1) & m;
+            countShifts(pos);
+        }
+        else
+        {
+            for(size_t i = pos; i + 1 < count; i++)
+                m_slots[base + ((h + i) & m)] = m_slots[base + ((h + i + 1) & m)];
+            countShifts(count - 1 - pos);
+        }
+        return p;
+    }
+
+    void insertPtr(size_t at, T* p)
+    {
+        if(at > m_size)
+            at = m_size;
+        if(m_size == (m_heads.size() << m_shift))
+            addBlock();
+
+        size_t b = blockSize();
+        size_t k = at >> m_shift, last = m_size >> m_shift;
+        size_t lastCount = m_size - (last << m_shift);
+
+        // Every following block passes it's last pointer to the next one
+        for(size_t j = last; j > k; j--)
+        {
+            T* moved = blockTake(j - 1, b, b - 1);
+            blockInsert(j, j == last ? lastCount : b - 1, 0, moved);
+        }
+        countShifts(last - k);
+
+        blockInsert(k, k == last ? lastCount : b - 1, at & mask(), p);
+        m_size++;
+        rebalance();
+    }
+
+    T* takePtr(size_t at)
+    {
+        assert(at < m_size);
+        size_t b = blockSize();
+        size_t k = at >> m_shift, last = (m_size - 1) >> m_shift;
+        size_t lastCount = m_size - (last << m_shift);
+
+        T* p = blockTake(k, k == last ? lastCount : b, at & mask());
+
+        // Every following block passes it's first pointer to the previous one
+        for(size_t j = k + 1; j <= last; j++)
+        {
+            T* moved = blockTake(j, j == last ? lastCount : b, 0);
+            blockInsert(j - 1, b - 1, b - 1, moved);
+        }
+        countShifts(last - k);
+
+        m_size--;
+        trimBlocks();
+        rebalance();
+        return p;
+    }
+
+    // Lays out pointers again with the new block size, all heads are zero after it
+    void relayout(size_t shift)
+    {
+        std::vector<T*> flat(m_size);
+        for(size_t i = 0; i < m_size; i++)
+            flat[i] = ptrAt(i);
+
+        m_shift = shift;
+        size_t blocks = ((m_size + blockSize() - 1) >> m_shift) + 1;
+        std::vector<T*> slots(blocks << m_shift, nullptr);
+        std::copy(flat.begin(), flat.end(), slots.begin());
+        m_slots.swap(slots);
+        m_heads.assign(blocks, 0);
+        countReallocation(sizeof(T*) * m_size);
+    }
+
+    void rebalance()
+    {
+        size_t b = blockSize();
+        if(m_size > 4 * b * b)
+            relayout(m_shift + 1);
+        else if(m_shift > minShift && m_size < b * b / 16)
+            relayout(m_shift - 1);
+    }
+
+    // Writes pointers in the given order, the layout is kept
+    void assignPtrs(const std::vector<T*>& ptrs)
+    {
+        for(size_t i = 0; i < m_size; i++)
+            ptrAt(i) = ptrs[i];
+    }
+
+    std::vector<T*> ptrs() const
+    {
+        std::vector<T*> flat(m_size);
+        for(size_t i = 0; i < m_size; i++)
+            flat[i] = ptrAt(i);
+        return flat;
+    }
+
+public:
+    template<class TT, class List>
+    class Iterator
+    {
+        friend class SegPtrList;
+        List*   m_list;
+        size_t  m_pos;
+        Iterator(List* l, size_t pos) :
+            m_list(l),
+            m_pos(pos)
+        {}
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T               value_type;
+        typedef std::ptrdiff_t  difference_type;
+        typedef TT*             pointer;
+        typedef TT&             reference;
+
+        Iterator() :
+            m_list(nullptr),
+            m_pos(0)
+        {}
+
+        // Allows to convert iterator into const_iterator
+        template<class UU, class UList>
+        Iterator(const Iterator<UU, UList>& o) :
+            m_list(o.list()),
+            m_pos(o.pos())
+        {}
+
+        List* list() const { return m_list; }
+        size_t pos() const { return m_pos; }
+
+        bool operator==(const Iterator& i) const { return m_pos == i.m_pos; }
+        bool operator!=(const Iterator& i) const { return m_pos != i.m_pos; }
+        bool operator<(const Iterator& i) const { return m_pos < i.m_pos; }
+        bool operator<=(const Iterator& i) const { return m_pos <= i.m_pos; }
+        bool operator>(const Iterator& i) const { return m_pos > i.m_pos; }
+        bool operator>=(const Iterator& i) const { return m_pos >= i.m_pos; }
+
+        Iterator& operator++() { m_pos++; return *this; }
+        Iterator operator++(int) { Iterator i = *this; m_pos++; return i; }
+        Iterator& operator--() { m_pos--; return *this; }
+        Iterator operator--(int) { Iterator i = *this; m_pos--; return i; }
+        Iterator& operator+=(difference_type inc) { m_pos += inc; return *this; }
+        Iterator& operator-=(difference_type dec) { m_pos -= dec; return *this; }
+        Iterator operator+(difference_type inc) const { return Iterator(m_list, m_pos + inc); }
+        Iterator operator-(difference_type dec) const { return Iterator(m_list, m_pos - dec); }
+        difference_type operator-(const Iterator& i) const { return difference_type(m_pos) - difference_type(i.m_pos); }
+
+        TT& operator*() const { return *m_list->ptrAt(m_pos); }
+        TT* operator->() const { return m_list->ptrAt(m_pos); }
+        TT& operator[](difference_type i) const { return *m_list->ptrAt(m_pos + i); }
+    };
+
+    typedef Iterator<T, SegPtrList>             iterator;
+    typedef Iterator<const T, const SegPtrList> const_iterator;
+    typedef T                                   value_type;
+    typedef size_t                              size_type;
+
+    SegPtrList() :
+        m_size(0),
+        m_shift(minShift),
+        m_storage()
+    {}
+
+    SegPtrList(size_t size) :
+        m_size(0),
+        m_shift(minShift),
+        m_storage()
+    {
+        resize(size);
+    }
+
+    SegPtrList(std::initializer_list<T> il) :
+        m_size(0),
+        m_shift(minShift),
+        m_storage()
+    {
+        for(const T& t : il)
+            push_back(t);
+    }
+
+    SegPtrList(const SegPtrList& o) :
+        PtrListCounters(),
+        m_size(0),
+        m_shift(minShift),
+        m_storage()
+    {
+        for(size_t i = 0; i < o.m_size; i++)
+            push_back(*o.ptrAt(i));
+    }
+
+    SegPtrList(SegPtrList&& o) :
+        PtrListCounters(),
+        m_size(0),
+        m_shift(minShift),
+        m_storage()
+    {
+        swap(o);
+    }
+
+    ~SegPtrList()
+    {
+        clear();
+    }
+
+    SegPtrList& operator=(const SegPtrList& o)
+    {
+        if(this != &o)
+        {
+            clear();
+            for(size_t i = 0; i < o.m_size; i++)
+                push_back(*o.ptrAt(i));
+        }
+        return *this;
+    }
+
+    SegPtrList& operator=(SegPtrList&& o)
+    {
+        if(this != &o)
+        {
+            clear();
+            swap(o);
+        }
+        return *this;
+    }
+
+    void swap(SegPtrList& o)
+    {
+        m_slots.swap(o.m_slots);
+        m_heads.swap(o.m_heads);
+        std::swap(m_size, o.m_size);
+        std::swap(m_shift, o.m_shift);
+        std::swap(m_storage, o.m_storage);
+    }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, m_size); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, m_size); }
+    const_iterator cbegin() const { return const_iterator(this, 0); }
+    const_iterator cend() const { return const_iterator(this, m_size); }
+
+    void clear()
+    {
+        if(m_size > 0)
+        {
+            std::vector<T*> flat = ptrs();
+            m_storage.destroyAll(flat.data(), m_size);
+            countFrees(m_size);
+        }
+        std::vector<T*>().swap(m_slots);
+        std::vector<size_t>().swap(m_heads);
+        m_size = 0;
+        m_shift = minShift;
+    }
+
+    size_t size() const
+    {
+        return m_size;
+    }
+
+    size_t count() const
+    {
+        return m_size;
+    }
+
+    bool empty() const
+    {
+        return m_size == 0;
+    }
+
+    bool isEmpty() const
+    {
+        return m_size == 0;
+    }
+
+    // Count of pointer slots in one block
+    size_t blockSlots() const
+    {
+        return blockSize();
+    }
+
+    void resize(size_t sz)
+    {
+        while(m_size > sz)
+            pop_back();
+        while(m_size < sz)
+            emplace_back();
+    }
+
+    Storage& storage()
+    {
+        return m_storage;
+    }
+
+    T& operator[](size_t index)
+    {
+        assert(index < m_size);
+        return *ptrAt(index);
+    }
+
+    const T& operator[](size_t index) const
+    {
+        assert(index < m_size);
+        return *ptrAt(index);
+    }
+
+    T& at(size_t index)
+    {
+        assert(index < m_size);
+        return *ptrAt(index);
+    }
+
+    const T& at(size_t index) const
+    {
+        assert(index < m_size);
+        return *ptrAt(index);
+    }
+
+    T& first()
+    {
+        assert(m_size > 0);
+        return *ptrAt(0);
+    }
+
+    T& front()
+    {
+        assert(m_size > 0);
+        return *ptrAt(0);
+    }
+
+    T& last()
+    {
+        assert(m_size > 0);
+        return *ptrAt(m_size - 1);
+    }
+
+    T& back()
+    {
+        assert(m_size > 0);
+        return *ptrAt(m_size - 1);
+    }
+
+    void push_back(const T& item)
+    {
+        insertPtr(m_size, createItem(item));
+    }
+
+    void push_back(T&& item)
+    {
+        insertPtr(m_size, createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        insertPtr(m_size, createItem(std::forward<Args>(args)...));
+    }
+
+    void append(const T& item)
+    {
+        push_back(item);
+    }
+
+    void append(T&& item)
+    {
+        push_back(std::move(item));
+    }
+
+    void push_front(const T& item)
+    {
+        insertPtr(0, createItem(item));
+    }
+
+    void push_front(T&& item)
+    {
+        insertPtr(0, createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace_front(Args&&... args)
+    {
+        insertPtr(0, createItem(std::forward<Args>(args)...));
+    }
+
+    void insert(size_t at, const T& item)
+    {
+        insertPtr(at, createItem(item));
+    }
+
+    void insert(size_t at, T&& item)
+    {
+        insertPtr(at, createItem(std::move(item)));
+    }
+
+    template<typename... Args>
+    void emplace(size_t at, Args&&... args)
+    {
+        insertPtr(at, createItem(std::forward<Args>(args)...));
+    }
+
+    void removeAt(size_t at)
+    {
+        destroyItem(takePtr(at));
+    }
+
+    // Range is removed by one pass over the following elements
+    void removeAt(size_t at, size_t num)
+    {
+        assert(at + num <= m_size);
+        if(num == 1)
+        {
+            removeAt(at);
+            return;
+        }
+        if(num == 0)
+            return;
+        for(size_t i = at; i < at + num; i++)
+            destroyItem(ptrAt(i));
+        for(size_t i = at + num; i < m_size; i++)
+            ptrAt(i - num) = ptrAt(i);
+        countShifts(m_size - at - num);
+        m_size -= num;
+        trimBlocks();
+        rebalance();
+    }
+
+    iterator erase(iterator pos)
+    {
+        removeAt(pos.m_pos);
+        return iterator(this, pos.m_pos);
+    }
+
+    iterator erase(iterator from, iterator to)
+    {
+        assert(from.m_pos <= to.m_pos);
+        removeAt(from.m_pos, to.m_pos - from.m_pos);
+        return iterator(this, from.m_pos);
+    }
+
+    void pop_back()
+    {
+        removeAt(m_size - 1);
+    }
+
+    void pop_front()
+    {
+        removeAt(0);
+    }
+
+    // Unordered removal: the last element takes the slot of removed one
+    void removeAtUnordered(size_t at)
+    {
+        assert(at < m_size);
+        size_t last = m_size - 1;
+        if(at != last)
+        {
+            swap(at, last);
+            countShifts(1);
+        }
+        removeAt(last);
+    }
+
+    bool removeOneUnordered(const T& item)
+    {
+        ssize_t at = indexOf(item);
+        if(at < 0)
+            return false;
+        removeAtUnordered(size_t(at));
+        return true;
+    }
+
+    template<class Predicate>
+    size_t removeIfUnordered(Predicate pred)
+    {
+        size_t removed = 0, i = 0;
+        while(i < m_size)
+        {
+            if(pred(*ptrAt(i)))
+            {
+                removeAtUnordered(i);
+                removed++;
+            }
+            else
+                i++;
+        }
+        return removed;
+    }
+
+    void swap(size_t from, size_t to)
+    {
+        assert(from < m_size);
+        assert(to < m_size);
+        std::swap(ptrAt(from), ptrAt(to));
+    }
+
+    void move(size_t from, size_t to)
+    {
+        assert(from < m_size);
+        assert(to < m_size);
+        if(from == to)
+            return;
+        insertPtr(to, takePtr(from));
+    }
+
+    bool contains(const T& item) const
+    {
+        return indexOf(item) >= 0;
+    }
+
+    ssize_t indexOf(const T& item) const
+    {
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(*ptrAt(i) == item)
+            {
+                countComparisons(i + 1);
+                return ssize_t(i);
+            }
+        }
+        countComparisons(m_size);
+        return -1;
+    }
+
+    ssize_t lastIndexOf(const T& item) const
+    {
+        for(size_t i = m_size; i > 0; i--)
+        {
+            if(*ptrAt(i - 1) == item)
+            {
+                countComparisons(m_size - i + 1);
+                return ssize_t(i - 1);
+            }
+        }
+        countComparisons(m_size);
+        return -1;
+    }
+
+    iterator find(const T& item)
+    {
+        ssize_t at = indexOf(item);
+        return iterator(this, at < 0 ? m_size : size_t(at));
+    }
+
+    bool removeOne(const T& item)
+    {
+        ssize_t at = indexOf(item);
+        if(at < 0)
+            return false;
+        removeAt(size_t(at));
+        return true;
+    }
+
+    size_t removeAll(const T& item)
+    {
+        countComparisons(m_size);
+        return removeIf([&item](const T& v) { return v == item; });
+    }
+
+    template<class Predicate>
+    bool removeOneIf(Predicate pred)
+    {
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(pred(*ptrAt(i)))
+            {
+                removeAt(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Removes all matching elements by one pass, returns count of removed
+    template<class Predicate>
+    size_t removeIf(Predicate pred)
+    {
+        size_t moveTo = 0, i = 0;
+        try
+        {
+            for(; i < m_size; i++)
+            {
+                T* p = ptrAt(i);
+                if(pred(*p))
+                {
+                    destroyItem(p);
+                    continue;
+                }
+                if(moveTo != i)
+                {
+                    ptrAt(moveTo) = p;
+                    countShifts(1);
+                }
+                moveTo++;
+            }
+        }
+        catch(...)
+        {
+            // Close the gap left by already destroyed elements, the rest is kept
+            for(; i < m_size; i++)
+                ptrAt(moveTo++) = ptrAt(i);
+            m_size = moveTo;
+            trimBlocks();
+            throw;
+        }
+        size_t removed = m_size - moveTo;
+        m_size = moveTo;
+        if(removed > 0)
+        {
+            trimBlocks();
+            rebalance();
+        }
+        return removed;
+    }
+
+    /*
+     * Sorting: pointers are sorted in a flat copy and written back,
+     * elements are never moved
+     */
+    template<class Compare>
+    void sort(Compare cmp)
+    {
+        std::vector<T*> flat = ptrs();
+        std::sort(flat.begin(), flat.end(), [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        assignPtrs(flat);
+    }
+
+    void sort()
+    {
+        sort(std::less<T>());
+    }
+
+    template<class Compare>
+    void stable_sort(Compare cmp)
+    {
+        std::vector<T*> flat = ptrs();
+        std::stable_sort(flat.begin(), flat.end(), [&cmp](const T* a, const T* b) { return cmp(*a, *b); });
+        assignPtrs(flat);
+    }
+
+    void stable_sort()
+    {
+        stable_sort(std::less<T>());
+    }
+
+    bool operator==(const SegPtrList& o) const
+    {
+        if(m_size != o.m_size)
+            return false;
+        for(size_t i = 0; i < m_size; i++)
+        {
+            if(!(*ptrAt(i) == *o.ptrAt(i)))
+                return false;
+        }
+        return true;
+    }
+
+    bool operator!=(const SegPtrList& o) const
+    {
+        return !operator==(o);
+    }
+};
+
+#endif // SEGPTRLIST_H
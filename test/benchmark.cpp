@@ -1,117 +1,461 @@
-
 #include "../ptrlist.h"
-#include "vptrlist.h"
-#include <chrono>
+#include "../vptrlist.h"
+#include "../segptrlist.h"
+#include "../ptrlist_cow.h"
+#include "benchmark_harness.h"
+#include <stdio.h>
+#include <string.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+ * Element types
+ */
+
+struct Blob256
+{
+    unsigned char bytes[256];
+
+    bool operator==(const Blob256 &o) const
+    {
+        return memcmp(bytes, o.bytes, sizeof(bytes)) == 0;
+    }
+};
+
+// Copying of strings only allocates memory, which is thread-safe
+template<>
+struct PtrListThreadSafeCopy<std::string> : std::true_type {};
+
+template<class T>
+struct Values;
+
+template<>
+struct Values<int>
+{
+    static const char *name() { return "int"; }
+    static int make(size_t i) { return int(i); }
+    static size_t checksum(const int &v) { return size_t(v); }
+};
+
+template<>
+struct Values<std::string>
+{
+    static const char *name() { return "string"; }
+    // Long enough to not fit the small string buffer
+    static std::string make(size_t i) { return "benchmark-element-" + std::to_string(i); }
+    static size_t checksum(const std::string &v) { return v.size() + size_t(v.back()); }
+};
+
+template<>
+struct Values<Blob256>
+{
+    static const char *name() { return "blob256"; }
+    static Blob256 make(size_t i)
+    {
+        Blob256 b;
+        memset(b.bytes, int(i & 0xFF), sizeof(b.bytes));
+        memcpy(b.bytes, &i, sizeof(i));
+        return b;
+    }
+    static size_t checksum(const Blob256 &v) { return v.bytes[0] + v.bytes[255]; }
+};
 
-class ElapsedTimer
+
+/*
+ * Bump allocator: takes memory from big chunks by shifting the pointer,
+ * releases nothing until the arena gets destroyed
+ */
+class BumpArena
 {
+    std::vector<char*> m_chunks;
+    size_t m_used;
+    size_t m_chunkSize;
 public:
-    typedef std::chrono::nanoseconds TimeT;
-    ElapsedTimer() {}
-    void start()
+    BumpArena(size_t chunkSize = 16 * 1024 * 1024) :
+        m_used(chunkSize),
+        m_chunkSize(chunkSize)
+    {}
+
+    ~BumpArena()
     {
-        recent = std::chrono::high_resolution_clock::now();
+        for(char *c : m_chunks)
+            free(c);
     }
-    void restart()
+
+    void *take(size_t size, size_t align)
     {
-        recent = std::chrono::high_resolution_clock::now();
+        m_used = (m_used + align - 1) & ~(align - 1);
+        if(m_used + size > m_chunkSize)
+        {
+            m_chunks.push_back((char*)malloc(m_chunkSize > size ? m_chunkSize : size));
+            m_used = 0;
+        }
+        void *ret = m_chunks.back() + m_used;
+        m_used += size;
+        return ret;
     }
-    int64_t elapsed()
+};
+
+static BumpArena *g_arena = nullptr;
+
+template<class T>
+struct BumpAllocator
+{
+    typedef T value_type;
+
+    BumpAllocator() {}
+    template<class U>
+    BumpAllocator(const BumpAllocator<U> &) {}
+
+    T *allocate(size_t n)
     {
-        using std::chrono::nanoseconds;
-        using std::chrono::duration_cast;
-        return duration_cast<nanoseconds>(std::chrono::high_resolution_clock::now() - recent).count();
+        return static_cast<T*>(g_arena->take(n * sizeof(T), alignof(T)));
     }
-    std::chrono::high_resolution_clock::time_point recent;
+
+    void deallocate(T *, size_t) {}
+};
+
+template<class T, class U>
+bool operator==(const BumpAllocator<T> &, const BumpAllocator<U> &) { return true; }
+template<class T, class U>
+bool operator!=(const BumpAllocator<T> &, const BumpAllocator<U> &) { return false; }
+
+
+/*
+ * Benchmark cases
+ */
+
+// Middle insertions and removals and lookups are slow, so they are timed by a limited count
+static const size_t g_middleOps = 100;
+static const size_t g_probes = 100;
+
+template<class List>
+static void fill(List &l, size_t n)
+{
+    typedef typename std::decay<decltype(*l.begin())>::type T;
+    for(size_t i = 0; i < n; i++)
+        l.push_back(Values<T>::make(i));
+}
+
+template<class List>
+struct Filled
+{
+    List list;
+};
+
+template<class List>
+struct Copied
+{
+    List list;
+    std::unique_ptr<List> copy;
+};
+
+template<class List, class T>
+static void runCommon(bench::Runner &r, const char *listName, size_t n)
+{
+    typedef Values<T> V;
+    size_t middleOps = std::min(n, g_middleOps);
+    bench::Case c = {listName, V::name(), "", n, n};
+
+    c.op = "append";
+    r.run<Filled<List> >(c, [](Filled<List> &) {},
+    [n](Filled<List> &s)
+    {
+        for(size_t i = 0; i < n; i++)
+            s.list.push_back(V::make(i));
+    });
+
+    c.op = "insert_middle";
+    c.ops = middleOps;
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [middleOps](Filled<List> &s)
+    {
+        for(size_t i = 0; i < middleOps; i++)
+            s.list.insert(s.list.size() / 2, V::make(i));
+    });
+
+    c.op = "erase_middle";
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [middleOps](Filled<List> &s)
+    {
+        for(size_t i = 0; i < middleOps; i++)
+            s.list.removeAt(s.list.size() / 2);
+    });
+
+    c.op = "erase_unordered";
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [middleOps](Filled<List> &s)
+    {
+        for(size_t i = 0; i < middleOps; i++)
+            s.list.removeAtUnordered(s.list.size() / 2);
+    });
+
+    // Half of probes are missing in the list
+    c.op = "contains";
+    c.ops = g_probes;
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [n](Filled<List> &s)
+    {
+        size_t found = 0;
+        for(size_t i = 0; i < g_probes; i++)
+            found += s.list.contains(V::make((i * 7919) % (n * 2)));
+        bench::doNotOptimize(found);
+    });
+
+    c.op = "iterate";
+    c.ops = n;
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [](Filled<List> &s)
+    {
+        size_t sum = 0;
+        for(T &v : s.list)
+            sum += V::checksum(v);
+        bench::doNotOptimize(sum);
+    });
+
+    c.op = "copy";
+    r.run<Copied<List> >(c, [n](Copied<List> &s) { fill(s.list, n); },
+    [](Copied<List> &s)
+    {
+        s.copy.reset(new List(s.list));
+    });
+
+    // Copy of the shared list, then the first write which detaches it
+    c.op = "copy_cow";
+    r.run<Filled<PtrListCow<List> > >(c, [n](Filled<PtrListCow<List> > &s) { fill(s.list.edit(), n); },
+    [](Filled<PtrListCow<List> > &s)
+    {
+        PtrListCow<List> copy(s.list);
+        bench::doNotOptimize(copy);
+    });
+
+    c.op = "copy_cow_write";
+    r.run<Filled<PtrListCow<List> > >(c, [n](Filled<PtrListCow<List> > &s) { fill(s.list.edit(), n); },
+    [](Filled<PtrListCow<List> > &s)
+    {
+        PtrListCow<List> copy(s.list);
+        copy.edit().pop_back();
+        bench::doNotOptimize(copy);
+    });
+
+    c.op = "clear";
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [](Filled<List> &s)
+    {
+        s.list.clear();
+    });
+}
+
+// Deep copy by the copy constructor and by clone() on all hardware threads
+template<class List, class T>
+static void runClone(bench::Runner &r, const char *listName, size_t n)
+{
+    bench::Case c = {listName, Values<T>::name(), "clone_sequential", n, n};
+    r.run<Copied<List> >(c, [n](Copied<List> &s) { fill(s.list, n); },
+    [](Copied<List> &s)
+    {
+        s.copy.reset(new List(s.list.clone(1)));
+    });
+
+    c.op = "clone_parallel";
+    r.run<Copied<List> >(c, [n](Copied<List> &s) { fill(s.list, n); },
+    [](Copied<List> &s)
+    {
+        s.copy.reset(new List(s.list.clone()));
+    });
+}
+
+// Double-ended operations, lookups by the hash index and sorting
+template<class List>
+static void runExtra(bench::Runner &r, const char *listName, size_t n)
+{
+    bench::Case c = {listName, "int", "", n, n};
+
+    c.op = "push_front";
+    r.run<Filled<List> >(c, [](Filled<List> &) {},
+    [n](Filled<List> &s)
+    {
+        for(size_t i = 0; i < n; i++)
+            s.list.push_front(int(i));
+    });
+
+    c.op = "pop_front";
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); },
+    [](Filled<List> &s)
+    {
+        while(s.list.size() > 0)
+            s.list.pop_front();
+    });
+
+    c.op = "contains_indexed";
+    c.ops = g_probes;
+    r.run<Filled<List> >(c, [n](Filled<List> &s) { fill(s.list, n); s.list.enableIndex(); },
+    [n](Filled<List> &s)
+    {
+        size_t found = 0;
+        for(size_t i = 0; i < g_probes; i++)
+            found += s.list.contains(int((i * 7919) % (n * 2)));
+        bench::doNotOptimize(found);
+    });
+
+    // The address index is filled by the first lookup, which isn't timed
+    c.op = "index_of_ptr";
+    r.run<Filled<List> >(c,
+    [n](Filled<List> &s)
+    {
+        fill(s.list, n);
+        s.list.enableAddressIndex();
+        bench::doNotOptimize(s.list.indexOfPtr(&s.list.back()));
+    },
+    [n](Filled<List> &s)
+    {
+        size_t sum = 0;
+        for(size_t i = 0; i < g_probes; i++)
+            sum += size_t(s.list.indexOfPtr(&s.list[(i * 7919) % n]));
+        bench::doNotOptimize(sum);
+    });
+
+    auto shuffled = [n](Filled<List> &s)
+    {
+        unsigned seed = 1;
+        for(size_t i = 0; i < n; i++)
+        {
+            seed = seed * 1103515245u + 12345u;
+            s.list.push_back(int(seed >> 8));
+        }
+    };
+
+    c.op = "stable_sort";
+    c.ops = n;
+    r.run<Filled<List> >(c, shuffled, [](Filled<List> &s) { s.list.stable_sort(); });
+
+    c.op = "parallel_sort";
+    r.run<Filled<List> >(c, shuffled, [](Filled<List> &s) { s.list.parallel_sort(); });
+
+    c.op = "stable_sort_by_key_cmp";
+    r.run<Filled<List> >(c, shuffled, [](Filled<List> &s)
+    {
+        s.list.stable_sort([](const int &l, const int &r) { return (l >> 4) < (r >> 4); });
+    });
+
+    c.op = "sort_by_key";
+    r.run<Filled<List> >(c, shuffled, [](Filled<List> &s)
+    {
+        s.list.sortByKey([](const int &v) { return v >> 4; });
+    });
+}
+
+// Many short lists, like per-entity child lists: filling, walking and releasing them
+template<class List>
+struct ManySmall
+{
+    std::vector<List> lists;
+};
+
+static const size_t g_smallListSize = 4;
+
+template<class List>
+static void runSmallLists(bench::Runner &r, const char *listName, size_t n)
+{
+    r.reportObjectSize(listName, sizeof(List));
+    size_t count = std::max(n / g_smallListSize, size_t(1));
+    bench::Case c = {listName, "int", "small_lists_fill", n, count * g_smallListSize};
+    r.run<ManySmall<List> >(c, [count](ManySmall<List> &s) { s.lists.resize(count); },
+    [](ManySmall<List> &s)
+    {
+        for(List &l : s.lists)
+        {
+            for(size_t i = 0; i < g_smallListSize; i++)
+                l.push_back(int(i));
+        }
+    });
+
+    auto filled = [count](ManySmall<List> &s)
+    {
+        s.lists.resize(count);
+        for(List &l : s.lists)
+            fill(l, g_smallListSize);
+    };
+
+    c.op = "small_lists_iterate";
+    r.run<ManySmall<List> >(c, filled,
+    [](ManySmall<List> &s)
+    {
+        size_t sum = 0;
+        for(List &l : s.lists)
+        {
+            for(int &v : l)
+                sum += size_t(v);
+        }
+        bench::doNotOptimize(sum);
+    });
+
+    c.op = "small_lists_clear";
+    r.run<ManySmall<List> >(c, filled,
+    [](ManySmall<List> &s)
+    {
+        for(List &l : s.lists)
+            l.clear();
+    });
+}
+
+// Every sample gets it's own arena which is released with the state
+struct BumpState
+{
+    std::unique_ptr<BumpArena> arena;
+    std::unique_ptr<VPtrList<int, BumpAllocator<int> > > list;
 };
 
-#define BENCHMARK(taskName, expression)\
-{\
-    ElapsedTimer clock;\
-    clock.start();\
-    {expression}\
-    int64_t done = clock.elapsed();\
-    printf("=== [%lli] nanoseconds == %s \n", static_cast<long long>(done), (taskName));\
-    fflush(stdout);\
+static void runBump(bench::Runner &r, size_t n)
+{
+    bench::Case c = {"VPtrList<bump>", "int", "append", n, n};
+    r.run<BumpState>(c,
+    [n](BumpState &s)
+    {
+        s.arena.reset(new BumpArena);
+        g_arena = s.arena.get();
+        // Not reserved, as the VPtrList/int/append case it's compared with
+        s.list.reset(new VPtrList<int, BumpAllocator<int> >);
+    },
+    [n](BumpState &s)
+    {
+        for(size_t i = 0; i < n; i++)
+            s.list->push_back(int(i));
+    });
+    g_arena = nullptr;
 }
 
+template<class T>
+static void runType(bench::Runner &r, size_t n)
+{
+    runCommon<VPtrList<T>, T>(r, "VPtrList", n);
+    runCommon<PtrList<T>, T>(r, "PtrList", n);
+    runCommon<PtrList<T, PtrListSlabStorage<T> >, T>(r, "PtrList<slab>", n);
+    runCommon<SegPtrList<T>, T>(r, "SegPtrList", n);
+    runClone<VPtrList<T>, T>(r, "VPtrList", n);
+    runClone<PtrList<T>, T>(r, "PtrList", n);
+    runClone<PtrList<T, PtrListSlabStorage<T> >, T>(r, "PtrList<slab>", n);
+}
+
+int main(int argc, char **argv)
+{
+    bench::Runner r;
+    if(!r.parseArgs(argc, argv))
+        return 1;
+
+    for(size_t n : r.sizes())
+    {
+        runType<int>(r, n);
+        runType<std::string>(r, n);
+        runType<Blob256>(r, n);
+        runExtra<VPtrList<int> >(r, "VPtrList", n);
+        runExtra<PtrList<int> >(r, "PtrList", n);
+        runBump(r, n);
+        runSmallLists<VPtrList<int> >(r, "VPtrList", n);
+        runSmallLists<PtrList<int> >(r, "PtrList", n);
+        runSmallLists<SmallPtrList<int, 8> >(r, "SmallPtrList<8>", n);
+    }
 
-int main()
-{
-    VPtrList<int>   xxx;
-    PtrList<int>    yyy;
-    int count = 10000000;
-
-    printf("Test with %d entries sizes\n", count);
-    fflush(stdout);
-
-    BENCHMARK("SH - adding", {
-                for(int i=0; i < count; i++)
-                    xxx.push_back(i);
-                  });
-    BENCHMARK("MY - adding", {
-                for(int i=0; i < count; i++)
-                    yyy.push_back(i);
-                  });
-
-    printf("\n");
-    fflush(stdout);
-
-    BENCHMARK("SH - deleting-from-middle", {
-                xxx.erase(xxx.begin()+500);
-                  });
-    BENCHMARK("MY - deleting-from-middle", {
-                yyy.erase(yyy.begin()+500);
-                  });
-
-    printf("\n");
-    fflush(stdout);
-
-    BENCHMARK("SH - contains", {
-                unsigned long long sum = 0;
-                if(xxx.contains(24562))
-                    sum += 1;
-                if(xxx.contains(34524562))
-                    sum += 1;
-                  });
-
-    BENCHMARK("MY - contains", {
-                unsigned long long sum = 0;
-                if(yyy.contains(24562))
-                    sum += 1;
-                if(yyy.contains(34524562))
-                    sum += 1;
-                  });
-
-    printf("\n");
-    fflush(stdout);
-
-    BENCHMARK("SH - iteration", {
-                  unsigned long long sum = 0;
-                    for(VPtrList<int>::iterator i = xxx.begin();
-                        i != xxx.end();
-                        i++)
-                        sum += (**i);
-                  });
-    BENCHMARK("MY - iteration", {
-                  unsigned long long sum = 0;
-                    for(PtrList<int>::iterator i = yyy.begin();
-                        i != yyy.end();
-                        i++)
-                        sum += (*i);
-                  });
-
-    printf("\n");
-    fflush(stdout);
-
-    BENCHMARK("SH - cleanup", {
-                    xxx.clear();
-                  });
-    BENCHMARK("MY - cleanup", {
-                    yyy.clear();
-                  });
-    printf("\n");
-    fflush(stdout);
-
-    return 0;
+    return r.writeJson() ? 0 : 1;
 }
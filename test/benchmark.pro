@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -11,6 +11,9 @@ QMAKE_CXXFLAGS_RELEASE += -static-libgcc -static-libstdc++
 DESTDIR = $$PWD/bin
 #DEFINES += INIDEBUG
 
+HEADERS += \
+    benchmark_harness.h
+
 SOURCES += \
     benchmark.cpp
 
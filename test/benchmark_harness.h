@@ -0,0 +1,287 @@
+/*
+ * Minimal benchmark harness: every case is warmed up, then timed by several
+ * samples each having it's own fresh state, and the median and p99 of samples
+ * are reported. Results are printed as a table and emitted as JSON.
+ */
+
+#ifndef PTRLIST_BENCHMARK_HARNESS_H
+#define PTRLIST_BENCHMARK_HARNESS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench
+{
+
+// Forces the compiler to assume that the value is used, so the computation of it can't be removed
+template<class T>
+inline void doNotOptimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "g"(&value) : "memory");
+#else
+    static const volatile void *sink;
+    sink = &value;
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+#endif
+}
+
+struct Options
+{
+    std::vector<size_t> sizes;
+    size_t      samples;
+    size_t      warmup;
+    std::string filter;
+    std::string output;
+
+    Options() :
+        sizes({1000, 10000, 100000}),
+        samples(11),
+        warmup(2)
+    {}
+};
+
+struct Case
+{
+    std::string list;
+    std::string type;
+    std::string op;
+    size_t      size;
+    // Count of elementary operations done by one sample, used for per-operation time
+    size_t      ops;
+
+    std::string name() const
+    {
+        return list + "/" + type + "/" + op + "/" + std::to_string(size);
+    }
+};
+
+struct Result
+{
+    Case    c;
+    size_t  samples;
+    int64_t minNs;
+    int64_t medianNs;
+    int64_t p99Ns;
+    int64_t maxNs;
+};
+
+class Runner
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Options m_options;
+    std::vector<Result> m_results;
+    // sizeof of list objects, reported once per list
+    std::vector<std::pair<std::string, size_t> > m_objectSizes;
+
+    static int64_t percentile(const std::vector<int64_t> &sorted, double p)
+    {
+        size_t rank = size_t(p * double(sorted.size()) + 0.999999);
+        if(rank == 0)
+            rank = 1;
+        if(rank > sorted.size())
+            rank = sorted.size();
+        return sorted[rank - 1];
+    }
+
+    static void usage(const char *app)
+    {
+        fprintf(stderr,
+                "Usage: %s [--sizes=N,N,...] [--samples=N] [--warmup=N] [--filter=TEXT] [--output=FILE]\n"
+                "  --sizes    list sizes to sweep (default 1000,10000,100000),\n"
+                "             'large' is the same as 1000000,10000000\n"
+                "  --samples  timed samples per case (default 11)\n"
+                "  --warmup   untimed runs per case (default 2)\n"
+                "  --filter   run only cases which name (list/type/op/size) contains TEXT\n"
+                "  --output   write JSON into FILE instead of the standard output\n",
+                app);
+    }
+
+    static void writeString(FILE *f, const std::string &s)
+    {
+        fputc('"', f);
+        for(char c : s)
+        {
+            if(c == '"' || c == '\\')
+                fputc('\\', f);
+            fputc(c, f);
+        }
+        fputc('"', f);
+    }
+
+public:
+    // Returns false if the application must quit
+    bool parseArgs(int argc, char **argv)
+    {
+        for(int i = 1; i < argc; i++)
+        {
+            std::string arg(argv[i]);
+            size_t eq = arg.find('=');
+            std::string key = arg.substr(0, eq);
+            std::string val = eq == std::string::npos ? std::string() : arg.substr(eq + 1);
+
+            if(key == "--sizes")
+            {
+                m_options.sizes.clear();
+                if(val == "large")
+                    val = "1000000,10000000";
+                const char *p = val.c_str();
+                while(*p)
+                {
+                    char *end;
+                    unsigned long long v = strtoull(p, &end, 10);
+                    if(end == p)
+                        break;
+                    m_options.sizes.push_back(size_t(v));
+                    p = (*end == ',') ? end + 1 : end;
+                }
+            }
+            else if(key == "--samples")
+                m_options.samples = std::max<size_t>(1, strtoull(val.c_str(), nullptr, 10));
+            else if(key == "--warmup")
+                m_options.warmup = strtoull(val.c_str(), nullptr, 10);
+            else if(key == "--filter")
+                m_options.filter = val;
+            else if(key == "--output")
+                m_options.output = val;
+            else
+            {
+                usage(argv[0]);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const std::vector<size_t> &sizes() const
+    {
+        return m_options.sizes;
+    }
+
+    void reportObjectSize(const std::string &list, size_t bytes)
+    {
+        for(const std::pair<std::string, size_t> &o : m_objectSizes)
+        {
+            if(o.first == list)
+                return;
+        }
+        m_objectSizes.push_back(std::make_pair(list, bytes));
+        fprintf(stderr, "%-48s object %llu bytes\n", list.c_str(), static_cast<unsigned long long>(bytes));
+    }
+
+    /*
+     * Every run gets a fresh State prepared by the setup(State&) which is not
+     * timed, then op(State&) is timed. Destruction of the state isn't timed too.
+     */
+    template<class State, class Setup, class Op>
+    void run(const Case &c, Setup setup, Op op)
+    {
+        std::string name = c.name();
+        if(!m_options.filter.empty() && name.find(m_options.filter) == std::string::npos)
+            return;
+
+        for(size_t i = 0; i < m_options.warmup; i++)
+        {
+            State s;
+            setup(s);
+            op(s);
+        }
+
+        std::vector<int64_t> times;
+        times.reserve(m_options.samples);
+        for(size_t i = 0; i < m_options.samples; i++)
+        {
+            State s;
+            setup(s);
+            Clock::time_point start = Clock::now();
+            op(s);
+            Clock::time_point stop = Clock::now();
+            doNotOptimize(s);
+            times.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+        }
+
+        std::sort(times.begin(), times.end());
+        Result r;
+        r.c = c;
+        r.samples = times.size();
+        r.minNs = times.front();
+        r.medianNs = percentile(times, 0.5);
+        r.p99Ns = percentile(times, 0.99);
+        r.maxNs = times.back();
+        m_results.push_back(r);
+
+        fprintf(stderr, "%-48s median %12lld ns  p99 %12lld ns  %10.1f ns/op\n",
+                name.c_str(),
+                static_cast<long long>(r.medianNs),
+                static_cast<long long>(r.p99Ns),
+                double(r.medianNs) / double(c.ops ? c.ops : 1));
+        fflush(stderr);
+    }
+
+    bool writeJson() const
+    {
+        FILE *f = m_options.output.empty() ? stdout : fopen(m_options.output.c_str(), "w");
+        if(!f)
+        {
+            fprintf(stderr, "Can't open %s for writing\n", m_options.output.c_str());
+            return false;
+        }
+
+        fprintf(f, "{\n  \"context\": {\n    \"compiler\": ");
+#if defined(__VERSION__)
+        writeString(f, __VERSION__);
+#else
+        writeString(f, "unknown");
+#endif
+        fprintf(f, ",\n    \"samples\": %llu,\n    \"warmup\": %llu,\n    \"object_bytes\": {",
+                static_cast<unsigned long long>(m_options.samples),
+                static_cast<unsigned long long>(m_options.warmup));
+        for(size_t i = 0; i < m_objectSizes.size(); i++)
+        {
+            fprintf(f, "%s", i ? ", " : "");
+            writeString(f, m_objectSizes[i].first);
+            fprintf(f, ": %llu", static_cast<unsigned long long>(m_objectSizes[i].second));
+        }
+        fprintf(f, "}\n  },\n  \"results\": [");
+
+        for(size_t i = 0; i < m_results.size(); i++)
+        {
+            const Result &r = m_results[i];
+            fprintf(f, "%s\n    {\"list\": ", i ? "," : "");
+            writeString(f, r.c.list);
+            fprintf(f, ", \"type\": ");
+            writeString(f, r.c.type);
+            fprintf(f, ", \"op\": ");
+            writeString(f, r.c.op);
+            fprintf(f, ", \"size\": %llu, \"ops\": %llu, \"samples\": %llu, "
+                       "\"min_ns\": %lld, \"median_ns\": %lld, \"p99_ns\": %lld, \"max_ns\": %lld, "
+                       "\"median_ns_per_op\": %.3f}",
+                    static_cast<unsigned long long>(r.c.size),
+                    static_cast<unsigned long long>(r.c.ops),
+                    static_cast<unsigned long long>(r.samples),
+                    static_cast<long long>(r.minNs),
+                    static_cast<long long>(r.medianNs),
+                    static_cast<long long>(r.p99Ns),
+                    static_cast<long long>(r.maxNs),
+                    double(r.medianNs) / double(r.c.ops ? r.c.ops : 1));
+        }
+
+        fprintf(f, "\n  ]\n}\n");
+        if(f != stdout)
+            fclose(f);
+        return true;
+    }
+};
+
+} // namespace bench
+
+#endif // PTRLIST_BENCHMARK_HARNESS_H
@@ -0,0 +1,614 @@
+/*
+ * Complexity regression tests: instead of timing, they count element copies,
+ * moves, comparisons and heap allocations done by every operation, and check
+ * them against the bounds of the expected complexity. So they are deterministic
+ * and don't depend on the machine load.
+ *
+ * Internal work of lists (pointer shifts, reallocations) is taken from their
+ * counters, so this test is built with PTRLIST_STATS defined.
+ */
+
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include <catch/catch.hpp>
+#include <stdlib.h>
+#include <new>
+#include <string>
+#include "../ptrlist.h"
+#include "../vptrlist.h"
+#include "../segptrlist.h"
+#include "../ptrlist_cow.h"
+
+static size_t g_allocations = 0;
+
+void *operator new(size_t size)
+{
+    g_allocations++;
+    void *p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    g_allocations++;
+    return malloc(size ? size : 1);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+struct Counters
+{
+    size_t allocations;
+    size_t copies;
+    size_t moves;
+    size_t compares;
+};
+
+static Counters g_counters = {0, 0, 0, 0};
+
+static Counters snapshot()
+{
+    Counters c = g_counters;
+    c.allocations = g_allocations;
+    return c;
+}
+
+static Counters since(const Counters &before)
+{
+    Counters now = snapshot();
+    Counters d;
+    d.allocations = now.allocations - before.allocations;
+    d.copies = now.copies - before.copies;
+    d.moves = now.moves - before.moves;
+    d.compares = now.compares - before.compares;
+    return d;
+}
+
+// Element which counts it's copies, moves and comparisons
+struct Probe
+{
+    int v;
+    Probe(int value = 0) : v(value) {}
+    Probe(const Probe &o) : v(o.v) { g_counters.copies++; }
+    Probe(Probe &&o) : v(o.v) { g_counters.moves++; }
+    Probe &operator=(const Probe &o) { v = o.v; g_counters.copies++; return *this; }
+    Probe &operator=(Probe &&o) { v = o.v; g_counters.moves++; return *this; }
+    bool operator==(const Probe &o) const { g_counters.compares++; return v == o.v; }
+    bool operator<(const Probe &o) const { g_counters.compares++; return v < o.v; }
+};
+
+namespace std
+{
+template<>
+struct hash<Probe>
+{
+    size_t operator()(const Probe &p) const { return std::hash<int>()(p.v); }
+};
+}
+
+static size_t log2ceil(size_t n)
+{
+    size_t l = 0;
+    while((size_t(1) << l) < n)
+        l++;
+    return l;
+}
+
+// Reallocations of the pointer array which aren't done through the operator new
+template<class T>
+static size_t arrayReallocations(const VPtrList<T> &)
+{
+    return 0;
+}
+
+template<class T>
+static size_t arrayReallocations(const PtrList<T> &l)
+{
+    return l.reallocations();
+}
+
+template<class List>
+static void fill(List &l, size_t n, int mod = 0)
+{
+    for(size_t i = 0; i < n; i++)
+        l.emplace_back(mod ? int(i) % mod : int(i));
+}
+
+template<class List>
+static void checkAppend(size_t n)
+{
+    List l;
+    Counters before = snapshot();
+    fill(l, n);
+    Counters d = since(before);
+    size_t arrayAllocs = d.allocations - n + arrayReallocations(l);
+
+    REQUIRE( l.size() == n );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    // Geometric growth, the linear one would give n / step reallocations
+    REQUIRE( arrayAllocs <= 2 * log2ceil(n) + 8 );
+    REQUIRE( l.stats().allocations == n );
+    REQUIRE( l.stats().reallocations <= 2 * log2ceil(n) + 8 );
+    REQUIRE( l.stats().shifts == 0 );
+
+    before = snapshot();
+    for(size_t i = 0; i < n; i++)
+        l.push_back(Probe(int(i)));
+    d = since(before);
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == n );
+}
+
+template<class List>
+static void checkPushFront(size_t n)
+{
+    List l;
+    Counters before = snapshot();
+    for(size_t i = 0; i < n; i++)
+        l.push_front(Probe(int(i)));
+    Counters d = since(before);
+    size_t arrayAllocs = d.allocations - n + arrayReallocations(l);
+
+    REQUIRE( l.size() == n );
+    REQUIRE( l.front().v == int(n - 1) );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == n );
+    REQUIRE( arrayAllocs <= 2 * log2ceil(n) + 8 );
+
+    REQUIRE( l.stats().reallocations <= 2 * log2ceil(n) + 8 );
+    // Copying of pointers into the new array is amortised O(1) per element
+    REQUIRE( l.stats().bytesCopied <= 4 * n * sizeof(void*) );
+
+    before = snapshot();
+    l.resetStats();
+    while(l.size() > 0)
+        l.pop_front();
+    d = since(before);
+    REQUIRE( d.allocations == 0 );
+    REQUIRE( arrayReallocations(l) == 0 );
+    REQUIRE( l.stats().shifts == 0 );
+    REQUIRE( l.stats().frees == n );
+}
+
+template<class List>
+static void checkRemoval(size_t n)
+{
+    List l;
+    fill(l, n, 4);
+    l.resetStats();
+
+    Counters before = snapshot();
+    size_t removed = l.removeAll(Probe(1));
+    Counters d = since(before);
+    REQUIRE( removed == n / 4 );
+    REQUIRE( l.size() == n - n / 4 );
+    // Single pass: one comparison per element and no element is touched
+    REQUIRE( d.compares == n );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.allocations == 0 );
+    // Every remained pointer is shifted at most once
+    REQUIRE( l.stats().shifts <= n );
+    REQUIRE( l.stats().comparisons == n );
+    REQUIRE( l.stats().frees == n / 4 );
+
+    size_t calls = 0;
+    size_t s = l.size();
+    removed = l.removeIf([&calls](const Probe &p) { calls++; return p.v == 2; });
+    REQUIRE( removed == n / 4 );
+    REQUIRE( calls == s );
+
+    before = snapshot();
+    REQUIRE( l.removeOne(Probe(3)) );
+    d = since(before);
+    REQUIRE( d.compares <= 4 );
+}
+
+template<class List>
+static void checkRangeInsert(size_t n, size_t k)
+{
+    List l, src;
+    fill(l, n);
+    fill(src, k);
+    l.shrink_to_fit();
+    l.resetStats();
+
+    Counters before = snapshot();
+    l.insert(n / 2, src);
+    Counters d = since(before);
+    REQUIRE( l.size() == n + k );
+    REQUIRE( d.copies == k );
+    REQUIRE( d.moves == 0 );
+    // One grow of the pointer array and one shift of the shorter part
+    REQUIRE( l.stats().reallocations <= 1 );
+    REQUIRE( l.stats().shifts <= n / 2 );
+
+    l.resetStats();
+    before = snapshot();
+    l.append(std::move(src));
+    d = since(before);
+    // Pointers are handed over, elements aren't touched
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( l.stats().allocations == 0 );
+    REQUIRE( l.stats().reallocations <= 1 );
+    REQUIRE( l.stats().shifts == 0 );
+}
+
+template<class List>
+static void checkUnordered(size_t n)
+{
+    List l;
+    fill(l, n, 4);
+    l.resetStats();
+    size_t calls = 0;
+    size_t removed = l.removeIfUnordered([&calls](const Probe &p) { calls++; return p.v == 1; });
+    REQUIRE( removed == n / 4 );
+    REQUIRE( calls == n );
+    // One pointer per removed element
+    REQUIRE( l.stats().shifts <= removed );
+
+    l.resetStats();
+    Counters before = snapshot();
+    while(l.size() > 1)
+        l.removeAtUnordered(l.size() / 2);
+    Counters d = since(before);
+    REQUIRE( l.stats().shifts < n );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.allocations == 0 );
+}
+
+static void checkDeferred(size_t n)
+{
+    PtrList<Probe> l;
+    fill(l, n);
+    l.resetStats();
+    Counters before = snapshot();
+    for(size_t i = 0; i < n; i += 3)
+        l.markRemoved(i);
+    size_t markShifts = l.stats().shifts;
+    size_t walked = 0;
+    for(Probe &p : l)
+        walked += (p.v % 3 != 0);
+    l.compact();
+    Counters d = since(before);
+    REQUIRE( markShifts == 0 );
+    REQUIRE( walked == n - (n + 2) / 3 );
+    // All holes are closed by one pass
+    REQUIRE( l.stats().shifts < n );
+    REQUIRE( l.stats().frees == (n + 2) / 3 );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.allocations == 0 );
+}
+
+template<class List>
+static void checkMiddle(size_t n, size_t ops)
+{
+    List l;
+    fill(l, n);
+    Counters before = snapshot();
+    for(size_t i = 0; i < ops; i++)
+        l.insert(l.size() / 2, Probe(-1));
+    for(size_t i = 0; i < ops; i++)
+        l.removeAt(l.size() / 2);
+    Counters d = since(before);
+    // Only pointers are shifted, elements themselves are never moved
+    REQUIRE( d.moves == ops );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.allocations <= ops + 2 * log2ceil(n + ops) );
+
+    // Near the front only the shorter part is shifted
+    l.resetStats();
+    for(size_t i = 0; i < ops; i++)
+        l.insert(1, Probe(-1));
+    for(size_t i = 0; i < ops; i++)
+        l.removeAt(1);
+    REQUIRE( l.stats().shifts <= 2 * ops );
+
+    l.resetStats();
+    l.move(0, n - 1);
+    REQUIRE( l.stats().shifts == n - 1 );
+}
+
+// Segmented list shifts about √n pointers per operation wherever it's done
+static void checkSegmented(size_t n, size_t ops)
+{
+    SegPtrList<Probe> l;
+    fill(l, n);
+    size_t b = l.blockSlots();
+    REQUIRE( b * b * 4 >= n );
+    REQUIRE( b * b <= n );
+
+    l.resetStats();
+    Counters before = snapshot();
+    for(size_t i = 0; i < ops; i++)
+        l.insert(l.size() / 3, Probe(-1));
+    for(size_t i = 0; i < ops; i++)
+        l.removeAt(l.size() / 3);
+    Counters d = since(before);
+    REQUIRE( d.moves == ops );
+    REQUIRE( d.copies == 0 );
+    // Half of block at most, plus one pointer per following block
+    REQUIRE( l.stats().shifts <= 2 * ops * (b / 2 + n / b + 1) );
+    REQUIRE( l.stats().shifts < 2 * ops * n / 8 );
+}
+
+template<class List>
+static void checkSort(size_t n)
+{
+    List l;
+    unsigned seed = 3;
+    for(size_t i = 0; i < n; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        l.emplace_back(int(seed >> 8));
+    }
+
+    List a(l), b(l), c(l);
+    Counters before = snapshot();
+    a.sort();
+    Counters d = since(before);
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.compares <= 3 * n * log2ceil(n) );
+
+    before = snapshot();
+    b.stable_sort();
+    d = since(before);
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.compares <= 3 * n * log2ceil(n) );
+
+    size_t keys = 0;
+    before = snapshot();
+    c.sortByKey([&keys](const Probe &p) { keys++; return p.v; });
+    d = since(before);
+    REQUIRE( keys == n );
+    REQUIRE( d.compares == 0 );
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+
+    bool same = true;
+    for(size_t i = 0; i < n; i++)
+        same = same && (a[i].v == b[i].v) && (b[i].v == c[i].v);
+    REQUIRE( same );
+}
+
+template<class List>
+static void checkIndex(size_t n, size_t probes)
+{
+    List l;
+    fill(l, n);
+    l.enableIndex();
+
+    size_t found = 0;
+    Counters before = snapshot();
+    for(size_t i = 0; i < probes; i++)
+        found += l.contains(Probe(int(i * 7)));
+    Counters d = since(before);
+    REQUIRE( found == (n + 6) / 7 );
+    // Hash collisions only, instead of n / 2 comparisons per lookup
+    REQUIRE( d.compares <= probes * 2 );
+}
+
+template<class List>
+static void checkAddressIndex(size_t n, size_t ops)
+{
+    List l;
+    fill(l, n);
+    l.enableAddressIndex();
+    // The first lookup indexes all slots
+    REQUIRE( l.indexOfPtr(&l[n / 2]) == ssize_t(n / 2) );
+    l.resetStats();
+
+    size_t root = 1;
+    while(root * root < n)
+        root++;
+    size_t found = 0;
+    for(size_t i = 0; i < ops; i++)
+    {
+        found += l.removeByPtr(&l[(i * 7919) % l.size()]);
+        size_t at = (i * 104729) % l.size();
+        found += (l.indexOfPtr(&l[at]) == ssize_t(at));
+    }
+    REQUIRE( found == 2 * ops );
+    REQUIRE( l.size() == n - ops );
+    // Amortised O(sqrt n) per operation, while the rescan of slots after the removed one is O(n)
+    REQUIRE( l.stats().indexVisits <= 4 * ops * root + 2 * n );
+}
+
+template<class List>
+static void checkCopy(size_t n)
+{
+    List l;
+    fill(l, n);
+    Counters before = snapshot();
+    List c(l);
+    Counters d = since(before);
+    REQUIRE( c.size() == n );
+    REQUIRE( d.copies == n );
+    REQUIRE( d.moves == 0 );
+    REQUIRE( d.allocations <= n + 2 );
+}
+
+template<class List>
+static void checkSplice(size_t n, size_t k)
+{
+    List a, b;
+    fill(a, n);
+    fill(b, n);
+    a.resetStats();
+    b.resetStats();
+    Counters before = snapshot();
+    b.splice(n / 2, a, n / 4, n / 4 + k);
+    for(size_t i = 0; i < k; i++)
+        a.adopt(b.release(0));
+    Counters d = since(before);
+    REQUIRE( d.copies == 0 );
+    REQUIRE( d.moves == 0 );
+    // Only the pointer arrays may grow
+    REQUIRE( d.allocations <= 2 );
+    REQUIRE( a.stats().allocations == 0 );
+    REQUIRE( b.stats().frees == 0 );
+    REQUIRE( a.stats().shifts <= n );
+    REQUIRE( a.size() == n );
+    REQUIRE( b.size() == n );
+}
+
+template<class List>
+static void checkCow(size_t n)
+{
+    PtrListCow<List> a;
+    fill(a.edit(), n);
+    Counters before = snapshot();
+    PtrListCow<List> b(a), c(a);
+    c = b;
+    Counters d = since(before);
+    size_t shareCopies = d.copies, shareAllocs = d.allocations;
+
+    before = snapshot();
+    b.edit().push_back(Probe(-1));
+    b.edit().push_back(Probe(-2));
+    d = since(before);
+    REQUIRE( shareCopies == 0 );
+    REQUIRE( shareAllocs == 0 );
+    // The first write copies elements once, the next ones don't
+    REQUIRE( d.copies == n );
+    REQUIRE( d.allocations <= n + 8 );
+    REQUIRE( a.size() == n );
+    REQUIRE( b.size() == n + 2 );
+}
+
+TEST_CASE( "Appending has amortised O(1) allocations", "[Complexity]" )
+{
+    checkAppend<PtrList<Probe> >(100000);
+    checkAppend<VPtrList<Probe> >(100000);
+}
+
+TEST_CASE( "Front operations have amortised O(1) allocations", "[Complexity]" )
+{
+    checkPushFront<PtrList<Probe> >(100000);
+    checkPushFront<VPtrList<Probe> >(100000);
+}
+
+TEST_CASE( "Removal by value is a single pass", "[Complexity]" )
+{
+    checkRemoval<PtrList<Probe> >(20000);
+    checkRemoval<VPtrList<Probe> >(20000);
+}
+
+TEST_CASE( "Range insertion grows and shifts once", "[Complexity]" )
+{
+    checkRangeInsert<PtrList<Probe> >(10000, 5000);
+    checkRangeInsert<VPtrList<Probe> >(10000, 5000);
+}
+
+TEST_CASE( "Unordered removal shifts one pointer", "[Complexity]" )
+{
+    checkUnordered<PtrList<Probe> >(100000);
+    checkUnordered<VPtrList<Probe> >(100000);
+}
+
+TEST_CASE( "Splicing moves pointers only", "[Complexity]" )
+{
+    checkSplice<PtrList<Probe> >(10000, 1000);
+    checkSplice<VPtrList<Probe> >(10000, 1000);
+}
+
+TEST_CASE( "Small lists don't allocate the pointer array", "[Complexity]" )
+{
+    SmallPtrList<Probe, 8> l;
+    fill(l, 8);
+    REQUIRE( l.stats().reallocations == 0 );
+    l.emplace_back(8);
+    REQUIRE( l.stats().reallocations == 1 );
+    REQUIRE( l.stats().bytesCopied == sizeof(Probe*) * 9 );
+}
+
+TEST_CASE( "Deferred removal compacts by one pass", "[Complexity]" )
+{
+    checkDeferred(100000);
+}
+
+TEST_CASE( "Middle insertions and removals don't touch elements", "[Complexity]" )
+{
+    checkMiddle<PtrList<Probe> >(10000, 100);
+    checkMiddle<VPtrList<Probe> >(10000, 100);
+}
+
+TEST_CASE( "Segmented list shifts O(sqrt n) pointers per operation", "[Complexity]" )
+{
+    checkSegmented(100000, 100);
+    checkSegmented(1000000, 100);
+}
+
+TEST_CASE( "Sorting is O(n log n) and permutes pointers only", "[Complexity]" )
+{
+    checkSort<PtrList<Probe> >(20000);
+    checkSort<VPtrList<Probe> >(20000);
+}
+
+TEST_CASE( "Indexed lookups are O(1)", "[Complexity]" )
+{
+    checkIndex<PtrList<Probe> >(10000, 10000);
+    checkIndex<VPtrList<Probe> >(10000, 10000);
+}
+
+TEST_CASE( "Removal by address keeps the address index", "[Complexity]" )
+{
+    checkAddressIndex<PtrList<Probe> >(20000, 2000);
+    checkAddressIndex<VPtrList<Probe> >(20000, 2000);
+}
+
+TEST_CASE( "Copying allocates every element once", "[Complexity]" )
+{
+    checkCopy<PtrList<Probe> >(10000);
+    checkCopy<VPtrList<Probe> >(10000);
+}
+
+TEST_CASE( "Copy-on-write copies are O(1) until written", "[Complexity]" )
+{
+    checkCow<PtrList<Probe> >(10000);
+    checkCow<VPtrList<Probe> >(10000);
+}
@@ -0,0 +1,27 @@
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS_RELEASE += -Ofast
+QMAKE_CFLAGS_RELEASE += -march=native
+QMAKE_CXXFLAGS_RELEASE += -march=native
+QMAKE_CXXFLAGS_RELEASE += -static-libgcc -static-libstdc++
+
+DESTDIR = $$PWD/bin
+#DEFINES += INIDEBUG
+DEFINES += PTRLIST_STATS
+
+include(catch/catch.pri)
+
+SOURCES += \
+    complexity.cpp
+
+HEADERS += \
+    ../ptrlist.h \
+    ../vptrlist.h \
+    ../segptrlist.h \
+    ../ptrlist_index.h \
+    ../ptrlist_sort.h \
+    ../ptrlist_stats.h \
+    ../ptrlist_cow.h
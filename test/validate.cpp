@@ -1,8 +1,13 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <catch/catch.hpp>
+#include <limits>
+#include <memory>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include "../ptrlist.h"
+#include "../ptrlist_cow.h"
 
 TEST_CASE( "vectors can be sized and resized", "[PtrList]" )
 {
@@ -235,3 +240,1524 @@ TEST_CASE( "Adding and removing items", "[PtrList]" )
         REQUIRE( copypasta.size() == 0 );
     }
 }
+
+TEST_CASE( "Slab-backed element storage", "[PtrList]" )
+{
+    PtrList<std::string, PtrListSlabStorage<std::string, 4> > v;
+
+    for(int i = 0; i < 10; i++)
+        v.push_back(std::to_string(i));
+
+    REQUIRE( v.size() == 10 );
+    REQUIRE( v.storage().pagesCount() == 3 );
+    REQUIRE( v[0] == "0" );
+    REQUIRE( v[9] == "9" );
+
+    // Elements of one page are placed next to each other
+    REQUIRE( &v[1] == &v[0] + 1 );
+    REQUIRE( &v[3] == &v[0] + 3 );
+
+    std::string *addr = &v[7];
+    v.removeAt(2);
+    v.removeOne("5");
+    REQUIRE( v.size() == 8 );
+    REQUIRE( &v[5] == addr );
+
+    // Released slots are reused before allocating a new page
+    v.push_back("10");
+    v.insert(0, "11");
+    REQUIRE( v.storage().pagesCount() == 3 );
+    REQUIRE( v[0] == "11" );
+    REQUIRE( v[9] == "10" );
+
+    PtrList<std::string, PtrListSlabStorage<std::string, 4> > copy = v;
+    REQUIRE( copy.size() == v.size() );
+    REQUIRE( copy[9] == "10" );
+    REQUIRE( &copy[9] != &v[9] );
+
+    v.clear();
+    REQUIRE( v.size() == 0 );
+    REQUIRE( v.storage().pagesCount() == 0 );
+
+    copy.resize(2);
+    REQUIRE( copy.size() == 2 );
+    REQUIRE( copy[1] == "0" );
+}
+
+TEST_CASE( "Growth policies of pointer array", "[PtrList]" )
+{
+    const size_t count = 100000;
+
+    SECTION( "Geometric growth does logarithmic count of reallocations" ) {
+        PtrList<int> v;
+        for(size_t i = 0; i < count; i++)
+            v.push_back(int(i));
+        REQUIRE( v.size() == count );
+        REQUIRE( v.capacity() >= count );
+        REQUIRE( v.reallocations() < 40 );
+    }
+
+    SECTION( "Fixed growth does linear count of reallocations" ) {
+        PtrList<int, PtrListHeapStorage<int>, PtrListFixedGrowth<1000> > v;
+        for(size_t i = 0; i < count; i++)
+            v.append(int(i));
+        REQUIRE( v.size() == count );
+        REQUIRE( v.reallocations() == count / 1000 + 1 );
+    }
+
+    SECTION( "Exact growth keeps capacity equal to size" ) {
+        PtrList<int, PtrListHeapStorage<int>, PtrListExactGrowth> v;
+        for(int i = 0; i < 100; i++)
+            v.insert(0, i);
+        REQUIRE( v.size() == 100 );
+        REQUIRE( v.capacity() == 100 );
+        REQUIRE( v[0] == 99 );
+        REQUIRE( v[99] == 0 );
+    }
+
+    SECTION( "Reserve sets the capacity and doesn't reallocate on push" ) {
+        PtrList<int> v;
+        v.reserve(1000);
+        REQUIRE( v.capacity() == 1000 );
+        REQUIRE( v.reallocations() == 1 );
+        for(int i = 0; i < 1000; i++)
+            v.push_back(i);
+        REQUIRE( v.reallocations() == 1 );
+    }
+
+    SECTION( "Reallocations are counted by the list object" ) {
+        PtrList<int> v;
+        v.reserve(10);
+        v.reserve(100);
+        REQUIRE( v.reallocations() == 2 );
+        REQUIRE( v.stats().reallocations == 2 );
+
+        PtrList<int> m(std::move(v));
+        REQUIRE( m.reallocations() == 0 );
+        PtrList<int> c(m);
+        REQUIRE( c.reallocations() == 1 );
+        m.swap(c);
+        REQUIRE( m.reallocations() == 0 );
+        REQUIRE( c.reallocations() == 1 );
+        c.resetStats();
+        REQUIRE( c.reallocations() == 0 );
+    }
+}
+
+TEST_CASE( "Double-ended operations", "[PtrList]" )
+{
+    PtrList<int> v;
+
+    SECTION( "push_front and pop_front don't shift the array" ) {
+        for(int i = 0; i < 1000; i++)
+            v.push_front(i);
+        REQUIRE( v.size() == 1000 );
+        REQUIRE( v.first() == 999 );
+        REQUIRE( v.last() == 0 );
+        REQUIRE( v.reallocations() < 30 );
+
+        int *addr = &v[500];
+        for(int i = 0; i < 500; i++)
+            v.pop_front();
+        REQUIRE( v.size() == 500 );
+        REQUIRE( &v[0] == addr );
+        REQUIRE( v[0] == 499 );
+
+        v.push_back(-1);
+        v.insert(1, -2);
+        REQUIRE( v[0] == 499 );
+        REQUIRE( v[1] == -2 );
+        REQUIRE( v[2] == 498 );
+        REQUIRE( v.last() == -1 );
+
+        v.removeAt(1);
+        REQUIRE( v[1] == 498 );
+        REQUIRE( v.size() == 501 );
+    }
+
+    SECTION( "Queue usage doesn't grow the array forever" ) {
+        for(int i = 0; i < 100000; i++)
+        {
+            v.push_back(i);
+            if(v.size() > 10)
+                v.pop_front();
+        }
+        REQUIRE( v.size() == 10 );
+        REQUIRE( v.first() == 99990 );
+        REQUIRE( v.capacity() < 100 );
+        v.clear();
+        REQUIRE( v.size() == 0 );
+    }
+
+    SECTION( "Removal of front items" ) {
+        for(int i = 0; i < 10; i++)
+            v.push_back(i);
+        v.removeAt(1, 3);
+        REQUIRE( v.size() == 7 );
+        REQUIRE( v[0] == 0 );
+        REQUIRE( v[1] == 4 );
+        while(v.size() > 0)
+            v.pop_front();
+        v.push_front(5);
+        v.push_front(6);
+        REQUIRE( v[0] == 6 );
+        REQUIRE( v[1] == 5 );
+    }
+}
+
+TEST_CASE( "Removal by predicate", "[PtrList]" )
+{
+    PtrList<int> v;
+    for(int i = 0; i < 20; i++)
+        v.push_back(i % 5);
+
+    int *kept = &v[1];
+
+    REQUIRE( v.removeAll(3) == 4 );
+    REQUIRE( v.size() == 16 );
+    REQUIRE( &v[1] == kept );
+    REQUIRE_FALSE( v.contains(3) );
+    REQUIRE( v.removeAll(42) == 0 );
+    REQUIRE( v.size() == 16 );
+
+    REQUIRE( v.removeOne(4) );
+    REQUIRE_FALSE( v.removeOne(42) );
+    REQUIRE( v.size() == 15 );
+    REQUIRE( v[3] == 0 );
+
+    REQUIRE( v.removeOneIf([](const int &i) { return i == 2; }) );
+    REQUIRE( v.size() == 14 );
+    REQUIRE( v[0] == 0 );
+    REQUIRE( v[1] == 1 );
+    REQUIRE( v[2] == 0 );
+
+    REQUIRE( v.removeIf([](const int &i) { return i % 2 == 0; }) == 10 );
+    REQUIRE( v.size() == 4 );
+    for(size_t i = 0; i < v.size(); i++)
+        REQUIRE( v[i] == 1 );
+    REQUIRE( &v[0] == kept );
+
+    REQUIRE( v.removeIf([](const int &) { return true; }) == 4 );
+    REQUIRE( v.size() == 0 );
+    v.push_back(7);
+    REQUIRE( v[0] == 7 );
+}
+
+struct IndexedItem
+{
+    int id;
+    std::string name;
+    bool operator==(const IndexedItem &o) const
+    {
+        return id == o.id && name == o.name;
+    }
+};
+
+TEST_CASE( "Hash index of elements", "[PtrList]" )
+{
+    SECTION( "Index by value" ) {
+        PtrList<int> v;
+        for(int i = 0; i < 1000; i++)
+            v.push_back(i);
+        v.enableIndex();
+        REQUIRE( v.isIndexed() );
+
+        REQUIRE( v.contains(500) );
+        REQUIRE_FALSE( v.contains(1000) );
+        REQUIRE( v.indexOf(500) == 500 );
+        REQUIRE( v.indexOf(1000) == -1 );
+
+        v.push_back(1000);
+        v.push_back(500);
+        REQUIRE( v.contains(1000) );
+        REQUIRE( v.indexOf(1000) == 1000 );
+        REQUIRE( v.indexOf(500) == 500 );
+
+        v.insert(10, 2000);
+        REQUIRE( v.indexOf(2000) == 10 );
+        REQUIRE( v.indexOf(500) == 501 );
+        REQUIRE( v.indexOf(999) == 1000 );
+
+        v.removeAt(5);
+        REQUIRE( v.indexOf(500) == 500 );
+        REQUIRE_FALSE( v.contains(5) );
+
+        v.swap(0, 1);
+        REQUIRE( v.indexOf(0) == 1 );
+        REQUIRE( v.indexOf(1) == 0 );
+
+        v.move(2, 998);
+        REQUIRE( v.indexOf(2) == 998 );
+        REQUIRE( v.indexOf(3) == 2 );
+
+        v.push_front(-1);
+        REQUIRE( v.indexOf(-1) == 0 );
+        REQUIRE( v.indexOf(3) == 3 );
+        v.pop_front();
+        REQUIRE_FALSE( v.contains(-1) );
+
+        REQUIRE( v.removeAll(500) == 2 );
+        REQUIRE_FALSE( v.contains(500) );
+        REQUIRE( v.removeAll(500) == 0 );
+        REQUIRE( v.removeOne(999) );
+        REQUIRE_FALSE( v.removeOne(999) );
+        REQUIRE( *v.find(1000) == 1000 );
+        REQUIRE( v.find(999) == v.end() );
+
+        PtrList<int> copy = v;
+        REQUIRE( copy.isIndexed() );
+        REQUIRE( copy.indexOf(1000) == v.indexOf(1000) );
+
+        v.clear();
+        REQUIRE_FALSE( v.contains(1000) );
+        v.disableIndex();
+        REQUIRE_FALSE( v.isIndexed() );
+    }
+
+    SECTION( "Index by key" ) {
+        PtrList<IndexedItem> v;
+        v.enableIndex([](const IndexedItem &i) { return i.id; });
+        v.push_back({1, "one"});
+        v.push_back({2, "two"});
+        v.push_back({2, "another two"});
+
+        REQUIRE( v.contains({2, "another two"}) );
+        REQUIRE_FALSE( v.contains({2, "three"}) );
+        REQUIRE( v.indexOf({2, "another two"}) == 2 );
+
+        v[1].name = "changed";
+        v.reindex();
+        REQUIRE( v.indexOf({2, "changed"}) == 1 );
+    }
+}
+
+TEST_CASE( "Sorting of pointers", "[PtrList]" )
+{
+    PtrList<int> v;
+    const int values[] = {42, 7, 13, 7, -5, 100, 0, 13, 8, 1};
+    for(int i : values)
+        v.push_back(i);
+
+    std::vector<int*> addresses;
+    for(size_t i = 0; i < v.size(); i++)
+        addresses.push_back(&v[i]);
+
+    SECTION( "sort keeps addresses of elements" ) {
+        v.sort();
+        for(size_t i = 1; i < v.size(); i++)
+            REQUIRE( v[i - 1] <= v[i] );
+        REQUIRE( v[0] == -5 );
+        REQUIRE( &v[0] == addresses[4] );
+        REQUIRE( &v[v.size() - 1] == addresses[5] );
+
+        v.sort(std::greater<int>());
+        REQUIRE( v[0] == 100 );
+        REQUIRE( v[9] == -5 );
+    }
+
+    SECTION( "stable_sort keeps order of equal elements" ) {
+        v.stable_sort([](const int &a, const int &b) { return (a & 1) < (b & 1); });
+        REQUIRE( &v[0] == addresses[0] );
+        REQUIRE( &v[1] == addresses[5] );
+        REQUIRE( &v[2] == addresses[6] );
+        REQUIRE( &v[3] == addresses[8] );
+        REQUIRE( &v[4] == addresses[1] );
+        REQUIRE( &v[5] == addresses[2] );
+        REQUIRE( &v[6] == addresses[3] );
+        REQUIRE( &v[7] == addresses[4] );
+    }
+
+    SECTION( "partial_sort and nth_element" ) {
+        v.partial_sort(3);
+        REQUIRE( v[0] == -5 );
+        REQUIRE( v[1] == 0 );
+        REQUIRE( v[2] == 1 );
+
+        v.nth_element(9);
+        REQUIRE( v[9] == 100 );
+        v.nth_element(4, std::greater<int>());
+        REQUIRE( v[4] == 8 );
+    }
+
+    SECTION( "sorting keeps the index valid" ) {
+        v.enableIndex();
+        REQUIRE( v.indexOf(100) == 5 );
+        v.sort();
+        REQUIRE( v.indexOf(100) == 9 );
+        REQUIRE( v.indexOf(-5) == 0 );
+    }
+}
+
+TEST_CASE( "Parallel sort", "[PtrList]" )
+{
+    PtrList<int> v, w;
+    unsigned seed = 12345;
+    for(int i = 0; i < 100000; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int val = int((seed >> 16) % 1000);
+        v.push_back(val);
+        w.push_back(val);
+    }
+
+    std::vector<int*> before;
+    for(size_t i = 0; i < v.size(); i++)
+        before.push_back(&v[i]);
+
+    auto byTens = [](const int &a, const int &b) { return a / 10 < b / 10; };
+
+    SECTION( "Result is identical to stable_sort" ) {
+        v.parallel_sort(byTens, 3, 1000);
+        w.stable_sort(byTens);
+        REQUIRE( v.size() == w.size() );
+        bool same = true;
+        for(size_t i = 0; i < v.size(); i++)
+            same = same && (v[i] == w[i]);
+        REQUIRE( same );
+
+        // Only pointers are moved
+        std::vector<int*> after;
+        for(size_t i = 0; i < v.size(); i++)
+            after.push_back(&v[i]);
+        std::sort(before.begin(), before.end());
+        std::sort(after.begin(), after.end());
+        REQUIRE( before == after );
+    }
+
+    SECTION( "Small lists are sorted sequentially" ) {
+        PtrList<int> s;
+        s.push_back(3);
+        s.push_back(1);
+        s.push_back(2);
+        s.parallel_sort(std::less<int>(), 8);
+        REQUIRE( s[0] == 1 );
+        REQUIRE( s[1] == 2 );
+        REQUIRE( s[2] == 3 );
+    }
+}
+
+struct SortItem
+{
+    int id;
+    float z;
+    std::string name;
+};
+
+TEST_CASE( "Sorting by cached keys", "[PtrList]" )
+{
+    PtrList<SortItem> v;
+    unsigned seed = 777;
+    for(int i = 0; i < 5000; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int r = int((seed >> 16) % 2000) - 1000;
+        v.push_back({r, float(r) * 0.25f, std::to_string(r % 37)});
+    }
+
+    std::vector<SortItem*> before;
+    for(size_t i = 0; i < v.size(); i++)
+        before.push_back(&v[i]);
+
+    SECTION( "Integral key by radix sort is stable" ) {
+        PtrList<SortItem> w = v;
+        v.sortByKey([](const SortItem &i) { return i.id / 16; });
+        w.stable_sort([](const SortItem &a, const SortItem &b) { return a.id / 16 < b.id / 16; });
+        bool same = true;
+        for(size_t i = 0; i < v.size(); i++)
+            same = same && (v[i].id == w[i].id);
+        REQUIRE( same );
+        REQUIRE( v[0].id < 0 );
+    }
+
+    SECTION( "Floating point key" ) {
+        v.sortByKey([](const SortItem &i) { return -i.z; });
+        bool sorted = true;
+        for(size_t i = 1; i < v.size(); i++)
+            sorted = sorted && (v[i - 1].z >= v[i].z);
+        REQUIRE( sorted );
+    }
+
+    SECTION( "Signed zeros and NaN keys" ) {
+        // Big enough for the radix sort, which must give the same order as the stable sort
+        PtrList<SortItem> z;
+        float nan = std::numeric_limits<float>::quiet_NaN();
+        float keys[] = {0.0f, -0.0f, 1.0f, nan, -nan, -1.0f, -0.0f, 0.0f};
+        for(int i = 0; i < 512; i++)
+            z.push_back({i, keys[i % 8], std::string()});
+        PtrList<SortItem> w = z;
+        z.sortByKey([](const SortItem &i) { return i.z; });
+        w.stable_sort([](const SortItem &a, const SortItem &b)
+        {
+            if(a.z != a.z)
+                return false;
+            return b.z != b.z || a.z < b.z;
+        });
+        bool same = true;
+        for(size_t i = 0; i < z.size(); i++)
+            same = same && (z[i].id == w[i].id);
+        REQUIRE( same );
+        REQUIRE( z[0].z == -1.0f );
+        REQUIRE( z[64].id == 0 );
+        REQUIRE( z[65].id == 1 );
+        REQUIRE( z[511].z != z[511].z );
+
+        PtrList<SortItem> d;
+        for(int i = 0; i < 300; i++)
+            d.push_back({i, 0.0f, std::string()});
+        d.sortByKey([](const SortItem &i) { return i.id % 2 ? -0.0 : 0.0; });
+        REQUIRE( d[1].id == 1 );
+        REQUIRE( d[299].id == 299 );
+    }
+
+    SECTION( "Non-arithmetic key" ) {
+        v.sortByKey([](const SortItem &i) { return i.name; });
+        bool sorted = true;
+        for(size_t i = 1; i < v.size(); i++)
+            sorted = sorted && (v[i - 1].name <= v[i].name);
+        REQUIRE( sorted );
+    }
+
+    std::vector<SortItem*> after;
+    for(size_t i = 0; i < v.size(); i++)
+        after.push_back(&v[i]);
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    REQUIRE( before == after );
+}
+
+struct CopyCounted
+{
+    static int copies;
+    std::string text;
+    CopyCounted(const std::string &t = std::string()) : text(t) {}
+    CopyCounted(const std::string &a, const std::string &b) : text(a + b) {}
+    CopyCounted(const CopyCounted &o) : text(o.text) { copies++; }
+    CopyCounted(CopyCounted &&o) : text(std::move(o.text)) {}
+    CopyCounted &operator=(const CopyCounted &o) { text = o.text; copies++; return *this; }
+    CopyCounted &operator=(CopyCounted &&o) { text = std::move(o.text); return *this; }
+    bool operator==(const CopyCounted &o) const { return text == o.text; }
+};
+
+int CopyCounted::copies = 0;
+
+static PtrList<CopyCounted> makeCopyCountedList(size_t num)
+{
+    PtrList<CopyCounted> l;
+    for(size_t i = 0; i < num; i++)
+        l.emplace_back(std::to_string(i));
+    return l;
+}
+
+TEST_CASE( "Move semantics", "[PtrList]" )
+{
+    CopyCounted::copies = 0;
+
+    SECTION( "Move constructor steals elements" ) {
+        PtrList<CopyCounted> a = makeCopyCountedList(100);
+        CopyCounted *first = &a[0];
+        PtrList<CopyCounted> b(std::move(a));
+        REQUIRE( a.size() == 0 );
+        REQUIRE( b.size() == 100 );
+        REQUIRE( &b[0] == first );
+        REQUIRE( b[99].text == "99" );
+        a.push_back(CopyCounted("reused"));
+        REQUIRE( a.size() == 1 );
+    }
+
+    SECTION( "Move assignment releases old content" ) {
+        PtrList<CopyCounted> a = makeCopyCountedList(10);
+        PtrList<CopyCounted> b = makeCopyCountedList(3);
+        CopyCounted *first = &a[0];
+        b = std::move(a);
+        REQUIRE( b.size() == 10 );
+        REQUIRE( &b[0] == first );
+        REQUIRE( a.size() == 0 );
+    }
+
+    SECTION( "Rvalue and emplace insertions don't copy" ) {
+        PtrList<CopyCounted> l;
+        CopyCounted c("moved");
+        l.push_back(std::move(c));
+        l.push_front(CopyCounted("front"));
+        l.append(CopyCounted("append"));
+        l.insert(1, CopyCounted("insert"));
+        l.emplace(2, "empl", "aced");
+        l.emplace_front("very front");
+        REQUIRE( l.size() == 6 );
+        REQUIRE( l[0].text == "very front" );
+        REQUIRE( l[1].text == "front" );
+        REQUIRE( l[2].text == "insert" );
+        REQUIRE( l[3].text == "emplaced" );
+        REQUIRE( l[4].text == "moved" );
+        REQUIRE( l[5].text == "append" );
+
+        PtrList<CopyCounted> other = makeCopyCountedList(5);
+        l.append(std::move(other));
+        REQUIRE( l.size() == 11 );
+        REQUIRE( l[10].text == "4" );
+        REQUIRE( other.size() == 0 );
+        REQUIRE( CopyCounted::copies == 0 );
+    }
+
+    SECTION( "Slab storage is moved with the elements" ) {
+        PtrList<int, PtrListSlabStorage<int, 8>> a;
+        for(int i = 0; i < 20; i++)
+            a.push_back(i);
+        PtrList<int, PtrListSlabStorage<int, 8>> b(std::move(a));
+        REQUIRE( a.storage().pagesCount() == 0 );
+        REQUIRE( b.storage().pagesCount() == 3 );
+        REQUIRE( b[19] == 19 );
+        a = std::move(b);
+        REQUIRE( a.storage().pagesCount() == 3 );
+        REQUIRE( a[5] == 5 );
+    }
+
+    SECTION( "Indexed list keeps the index" ) {
+        PtrList<CopyCounted> a = makeCopyCountedList(10);
+        a.enableIndex([](const CopyCounted &c) { return c.text; });
+        PtrList<CopyCounted> b(std::move(a));
+        REQUIRE( b.isIndexed() );
+        REQUIRE( !a.isIndexed() );
+        REQUIRE( b.indexOf(CopyCounted("7")) == 7 );
+    }
+}
+
+TEST_CASE( "Counters are compiled out by default", "[PtrList]" )
+{
+    // Only PtrList always keeps the count of reallocations
+    REQUIRE( std::is_empty<PtrListCounters>::value );
+    REQUIRE( sizeof(PtrListReallocationCounters) == sizeof(size_t) );
+    PtrList<int> v;
+    for(int i = 0; i < 100; i++)
+        v.push_back(i);
+    v.removeAll(5);
+    REQUIRE( v.stats().allocations == 0 );
+    REQUIRE( v.stats().comparisons == 0 );
+    REQUIRE( v.stats().reallocations == v.reallocations() );
+    REQUIRE( v.reallocations() > 0 );
+    REQUIRE( PtrListCounters::globalStats().allocations == 0 );
+}
+
+TEST_CASE( "Index positions after removal by predicate", "[PtrList]" )
+{
+    PtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+    v.enableIndex();
+    REQUIRE( v.indexOf(9) == 9 );
+    REQUIRE( v.removeIf([](const int &i) { return i == 2 || i == 8; }) == 2 );
+    REQUIRE( v.indexOf(3) == 2 );
+    REQUIRE( v.indexOf(7) == 6 );
+    REQUIRE( v.indexOf(9) == 7 );
+}
+
+TEST_CASE( "Memory usage and shrinking", "[PtrList]" )
+{
+    PtrList<int> v;
+    REQUIRE( v.memoryUsage().total() == 0 );
+
+    for(int i = 0; i < 1000; i++)
+        v.push_back(i);
+    for(int i = 0; i < 100; i++)
+        v.pop_front();
+
+    PtrListMemoryUsage u = v.memoryUsage();
+    REQUIRE( u.elements == 900 * sizeof(int) );
+    REQUIRE( u.pointerArray >= (v.capacity() + 1) * sizeof(int*) );
+    REQUIRE( u.slack == u.pointerArray - 901 * sizeof(int*) );
+    REQUIRE( u.slack >= 100 * sizeof(int*) );
+    REQUIRE( u.overhead > 0 );
+    REQUIRE( u.total() == u.pointerArray + u.elements + u.overhead );
+
+    int *first = &v[0];
+    v.shrink_to_fit();
+    REQUIRE( v.capacity() == 900 );
+    REQUIRE( &v[0] == first );
+    REQUIRE( v[899] == 999 );
+    u = v.memoryUsage();
+    REQUIRE( u.slack == 0 );
+    REQUIRE( u.pointerArray == 901 * sizeof(int*) );
+
+    v.push_front(-1);
+    v.push_back(1000);
+    REQUIRE( v.size() == 902 );
+    REQUIRE( v[0] == -1 );
+    REQUIRE( v[901] == 1000 );
+
+    v.clear();
+    v.reserve(100);
+    v.shrink_to_fit();
+    REQUIRE( v.capacity() == 0 );
+    REQUIRE( v.memoryUsage().total() == 0 );
+    v.push_back(5);
+    REQUIRE( v[0] == 5 );
+
+    PtrList<int, PtrListSlabStorage<int, 64> > slab;
+    for(int i = 0; i < 100; i++)
+        slab.push_back(i);
+    u = slab.memoryUsage();
+    REQUIRE( u.elements == 100 * sizeof(int) );
+    // Two pages with 28 free slots
+    REQUIRE( u.overhead >= 28 * sizeof(int) );
+}
+
+TEST_CASE( "Failed allocation keeps the list", "[PtrList]" )
+{
+    // No allocator can give a half of the address space
+    const size_t huge = std::numeric_limits<size_t>::max() / (2 * sizeof(int*));
+
+    PtrList<int> empty;
+    REQUIRE_THROWS_AS( empty.reserve(huge), std::bad_alloc );
+    REQUIRE( empty.capacity() == 0 );
+    empty.push_back(1);
+    REQUIRE( empty[0] == 1 );
+
+    PtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+    int *first = &v[0];
+    size_t capacity = v.capacity();
+    REQUIRE_THROWS_AS( v.reserve(huge), std::bad_alloc );
+    REQUIRE( v.capacity() == capacity );
+    REQUIRE( v.size() == 10 );
+    REQUIRE( &v[0] == first );
+    REQUIRE( v[9] == 9 );
+    v.push_back(10);
+    REQUIRE( v[10] == 10 );
+}
+
+TEST_CASE( "Lookups by element address", "[PtrList]" )
+{
+    PtrList<int> v;
+    for(int i = 0; i < 20; i++)
+        v.push_back(i % 5);
+
+    SECTION( "Without index" ) {
+    }
+
+    SECTION( "Address index" ) {
+        v.enableAddressIndex();
+        REQUIRE( v.isAddressIndexed() );
+    }
+
+    SECTION( "Hash index" ) {
+        v.enableIndex();
+    }
+
+    // Duplicates are told apart by the address
+    int *dup = &v[12];
+    REQUIRE( v.indexOf(2) == 2 );
+    REQUIRE( v.indexOfPtr(dup) == 12 );
+    REQUIRE( &*v.iteratorFor(dup) == dup );
+
+    int outside = 2;
+    REQUIRE( v.indexOfPtr(&outside) == -1 );
+    REQUIRE( v.iteratorFor(&outside) == v.end() );
+    REQUIRE( !v.removeByPtr(&outside) );
+
+    v.insert(3, 100);
+    v.push_front(-1);
+    REQUIRE( v.indexOfPtr(dup) == 14 );
+    v.swap(0, 14);
+    REQUIRE( v.indexOfPtr(dup) == 0 );
+    v.move(0, 10);
+    REQUIRE( v.indexOfPtr(dup) == 10 );
+    v.stable_sort();
+    REQUIRE( v[size_t(v.indexOfPtr(dup))] == 2 );
+    REQUIRE( &v[size_t(v.indexOfPtr(dup))] == dup );
+
+    int *last = &v.back();
+    REQUIRE( v.removeByPtr(dup) );
+    REQUIRE( v.indexOfPtr(dup) == -1 );
+    REQUIRE( v.size() == 21 );
+    REQUIRE( v.indexOfPtr(last) == 20 );
+    size_t twos = 0;
+    for(int i : v)
+        twos += (i == 2);
+    REQUIRE( twos == 3 );
+
+    v.removeAt(0, 5);
+    REQUIRE( v.indexOfPtr(last) == 15 );
+    v.clear();
+    REQUIRE( v.indexOfPtr(last) == -1 );
+}
+
+TEST_CASE( "Address index follows mixed operations", "[PtrList]" )
+{
+    PtrList<int> v;
+    v.enableAddressIndex();
+    for(int i = 0; i < 300; i++)
+        v.push_back(i);
+
+    unsigned seed = 12345;
+    for(int step = 0; step < 3000; step++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t at = v.size() == 0 ? 0 : (seed >> 8) % v.size();
+        switch(step % 9)
+        {
+        case 0: v.insert(at, step); break;
+        case 1: if(!v.size() == 0) v.removeAt(at); break;
+        case 2: v.push_front(step); break;
+        case 3: if(!v.size() == 0) v.pop_front(); break;
+        case 4: v.push_back(step); break;
+        case 5: if(!v.size() == 0) v.swap(at, v.size() - 1); break;
+        case 6: if(!v.size() == 0) REQUIRE( v.removeByPtr(&v[at]) ); break;
+        case 7: if(!v.size() == 0) v.pop_back(); break;
+        case 8:
+            if(step % 90 == 8)
+                v.move(0, v.size() / 2);
+            else if(step % 90 == 17)
+                v.resize(v.size() - v.size() / 8);
+            else
+                v.insert(at, {step, step + 1});
+            break;
+        }
+
+        // Every element is found at it's slot
+        for(size_t i = 0; i < v.size(); i += (step % 100 == 0) ? 1 : 17)
+            REQUIRE( v.indexOfPtr(&v[i]) == ssize_t(i) );
+    }
+}
+
+TEST_CASE( "Unordered removal", "[PtrList]" )
+{
+    PtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+
+    SECTION( "By position" ) {
+        int *last = &v[9];
+        v.removeAtUnordered(2);
+        REQUIRE( v.size() == 9 );
+        REQUIRE( &v[2] == last );
+        REQUIRE( v[8] == 8 );
+        v.removeAtUnordered(8);
+        REQUIRE( v.size() == 8 );
+        REQUIRE( v.back() == 7 );
+    }
+
+    SECTION( "By value" ) {
+        v.enableIndex();
+        REQUIRE( v.removeOneUnordered(0) );
+        REQUIRE( !v.removeOneUnordered(0) );
+        REQUIRE( v[0] == 9 );
+        REQUIRE( v.indexOf(9) == 0 );
+        REQUIRE( v.indexOf(8) == 8 );
+    }
+
+    SECTION( "By predicate" ) {
+        // Elements moved into the hole are checked too
+        REQUIRE( v.removeIfUnordered([](const int &i) { return i == 1 || i >= 7; }) == 4 );
+        REQUIRE( v.size() == 6 );
+        int sum = 0;
+        for(int i : v)
+            sum += i;
+        REQUIRE( sum == 0 + 2 + 3 + 4 + 5 + 6 );
+        REQUIRE( v[1] == 6 );
+        REQUIRE( v.removeIfUnordered([](const int &) { return true; }) == 6 );
+        REQUIRE( v.size() == 0 );
+    }
+}
+
+template<class List>
+static List makeRangeList()
+{
+    List l;
+    for(int i = 0; i < 5; i++)
+        l.push_back(i);
+    return l;
+}
+
+TEST_CASE( "Range insertions", "[PtrList]" )
+{
+    PtrList<int> v = makeRangeList<PtrList<int> >();
+    std::vector<int> src = {100, 101, 102};
+
+    SECTION( "Iterators" ) {
+        v.insert(1, src.begin(), src.end());
+        REQUIRE( v.size() == 8 );
+        REQUIRE( v[0] == 0 );
+        REQUIRE( v[1] == 100 );
+        REQUIRE( v[3] == 102 );
+        REQUIRE( v[4] == 1 );
+        v.append(src.begin(), src.begin() + 2);
+        REQUIRE( v.size() == 10 );
+        REQUIRE( v[9] == 101 );
+        v.insert(9, src.end(), src.end());
+        REQUIRE( v.size() == 10 );
+    }
+
+    SECTION( "Initializer lists" ) {
+        v.insert(4, {7, 8});
+        v.append({9});
+        v.insert(0, {-2, -1});
+        REQUIRE( v.size() == 10 );
+        int expected[] = {-2, -1, 0, 1, 2, 3, 7, 8, 4, 9};
+        bool same = true;
+        for(size_t i = 0; i < 10; i++)
+            same = same && v[i] == expected[i];
+        REQUIRE( same );
+    }
+
+    SECTION( "Other list" ) {
+        PtrList<int> o = makeRangeList<PtrList<int> >();
+        int *first = &v[0];
+        v.insert(2, o);
+        REQUIRE( v.size() == 10 );
+        REQUIRE( o.size() == 5 );
+        REQUIRE( &v[0] == first );
+        REQUIRE( v[2] == 0 );
+        REQUIRE( v[6] == 4 );
+        REQUIRE( v[7] == 2 );
+
+        const PtrList<int> &c = o;
+        v.append(c);
+        REQUIRE( v.size() == 15 );
+        REQUIRE( v[14] == 4 );
+
+        v.append(v);
+        REQUIRE( v.size() == 30 );
+        REQUIRE( v[15] == 0 );
+        REQUIRE( v[29] == 4 );
+
+        const int *o4 = &o[4];
+        v.insert(0, std::move(o));
+        REQUIRE( o.size() == 0 );
+        REQUIRE( v.size() == 35 );
+        REQUIRE( v[4] == 4 );
+        REQUIRE( &v[4] == o4 );
+        REQUIRE( v[5] == 0 );
+        o.push_back(1);
+        REQUIRE( o.size() == 1 );
+
+        // Handing the list over to itself copies it like the const overload
+        PtrList<int> d = makeRangeList<PtrList<int> >();
+        d.insert(1, std::move(d));
+        REQUIRE( d.size() == 10 );
+        REQUIRE( d[0] == 0 );
+        REQUIRE( d[1] == 0 );
+        REQUIRE( d[5] == 4 );
+        REQUIRE( d[6] == 1 );
+        REQUIRE( d[9] == 4 );
+
+        // Elements of the slab storage can't leave their list, so they are moved
+        PtrList<int, PtrListSlabStorage<int, 4> > sa, sb;
+        for(int i = 0; i < 10; i++)
+            sb.push_back(i);
+        sa.push_back(-1);
+        sa.append(std::move(sb));
+        REQUIRE( sa.size() == 11 );
+        REQUIRE( sa[10] == 9 );
+        REQUIRE( sb.size() == 0 );
+    }
+
+    SECTION( "Index is kept" ) {
+        v.enableIndex();
+        v.insert(2, src.begin(), src.end());
+        REQUIRE( v.indexOf(101) == 3 );
+        REQUIRE( v.indexOf(4) == 7 );
+        REQUIRE( v.contains(102) );
+    }
+}
+
+TEST_CASE( "Deferred removal", "[PtrList]" )
+{
+    PtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+    int *seven = &v[7];
+
+    // Removal while walking by positions doesn't shift others
+    for(size_t i = 0; i < v.size(); i++)
+    {
+        if(v[i] % 3 == 0)
+            v.markRemoved(i);
+    }
+    REQUIRE( v.size() == 10 );
+    REQUIRE( v.removedCount() == 4 );
+    REQUIRE( v.isRemoved(3) );
+    REQUIRE( !v.isRemoved(4) );
+    REQUIRE( &v[7] == seven );
+
+    int expected[] = {1, 2, 4, 5, 7, 8};
+    SECTION( "Iteration skips holes" ) {
+        size_t n = 0;
+        bool same = true;
+        for(int &i : v)
+            same = same && i == expected[n++];
+        REQUIRE( n == 6 );
+        REQUIRE( same );
+        const PtrList<int> &c = v;
+        REQUIRE( *c.begin() == 1 );
+
+        PtrList<int> copy(v);
+        REQUIRE( copy.size() == 6 );
+        REQUIRE( copy[5] == 8 );
+        REQUIRE( copy == v );
+    }
+
+    SECTION( "Walking by positions again" ) {
+        // size() still counts holes, so they are checked by isRemoved()
+        int sum = 0;
+        size_t live = 0;
+        for(size_t i = 0; i < v.size(); i++)
+        {
+            if(v.isRemoved(i))
+                continue;
+            sum += v[i];
+            live++;
+        }
+        REQUIRE( live == 6 );
+        REQUIRE( sum == 27 );
+        REQUIRE( v.removedCount() == 4 );
+    }
+
+    SECTION( "Accessors don't close holes" ) {
+        v.markRemoved(size_t(8));
+        REQUIRE( v.front() == 1 );
+        REQUIRE( v.back() == 7 );
+        REQUIRE( v.first() == 1 );
+        REQUIRE( v.last() == 7 );
+        REQUIRE( v.removedCount() == 5 );
+
+        // Every element is visited while removing and reading the ends
+        size_t visited = 0;
+        for(PtrList<int>::iterator it = v.begin(); it != v.end(); ++it)
+        {
+            visited++;
+            if(*it == 4)
+                v.markRemoved(it);
+            REQUIRE( v.front() == 1 );
+            REQUIRE( v.back() == 7 );
+        }
+        REQUIRE( visited == 5 );
+        REQUIRE( v.removedCount() == 6 );
+    }
+
+    SECTION( "Iterator arithmetic skips holes" ) {
+        PtrList<int>::iterator it = v.begin() + 2;
+        REQUIRE( *it == 4 );
+        it += 4;
+        REQUIRE( *it == 8 );
+        // Slot 6 is a hole, moving backward stops at the previous element
+        it = it - 2;
+        REQUIRE( *it == 5 );
+        REQUIRE( *(v.begin() + 0) == 1 );
+        PtrList<int>::const_iterator c = v.cbegin();
+        c += 5;
+        REQUIRE( *c == 7 );
+        PtrList<int> empty;
+        REQUIRE( empty.begin() + 0 == empty.end() );
+    }
+
+    SECTION( "Postfix increment returns the old position" ) {
+        PtrList<int>::iterator it = v.begin() + 2;
+        PtrList<int>::iterator old = it++;
+        REQUIRE( *old == 4 );
+        REQUIRE( *it == 5 );
+        // Slot 6 is a hole, postfix skips it like prefix does
+        REQUIRE( *it++ == 5 );
+        REQUIRE( *it == 7 );
+        PtrList<int>::const_iterator c = v.cbegin();
+        REQUIRE( *c++ == 1 );
+        REQUIRE( *c == 2 );
+        const PtrList<int>::const_iterator first = v.cbegin();
+        REQUIRE( first != c );
+        REQUIRE( std::distance(v.begin(), v.end()) == 6 );
+    }
+
+    SECTION( "Explicit compaction" ) {
+        REQUIRE( v.markRemoved(seven) );
+        v.compact();
+        REQUIRE( v.size() == 5 );
+        REQUIRE( v.removedCount() == 0 );
+        REQUIRE( v[3] == 5 );
+        REQUIRE( v[4] == 8 );
+    }
+
+    SECTION( "Positions are translated" ) {
+        // Slot 7 is the element 7, it's the 5th live one
+        v.removeAt(7);
+        REQUIRE( v.size() == 5 );
+        REQUIRE( v[4] == 8 );
+        v.markRemoved(size_t(0));
+        v.insert(2, 100);
+        REQUIRE( v[0] == 2 );
+        REQUIRE( v[1] == 100 );
+        v.markRemoved(v.begin());
+        v.pop_back();
+        REQUIRE( v.size() == 3 );
+        REQUIRE( v.back() == 5 );
+    }
+
+    SECTION( "Lookups and sorting close holes" ) {
+        v.enableIndex();
+        REQUIRE( v.indexOf(7) == 4 );
+        REQUIRE( v.removedCount() == 0 );
+        v.markRemoved(size_t(0));
+        REQUIRE( !v.contains(1) );
+        v.markRemoved(size_t(0));
+        v.sort(std::greater<int>());
+        REQUIRE( v.size() == 4 );
+        REQUIRE( v[0] == 8 );
+    }
+
+    SECTION( "Appending compacts past the ratio" ) {
+        v.setCompactRatio(0.5f);
+        v.push_back(10);
+        REQUIRE( v.removedCount() == 4 );
+        v.markRemoved(size_t(1));
+        v.markRemoved(size_t(2));
+        v.push_back(11);
+        REQUIRE( v.removedCount() == 0 );
+        REQUIRE( v.size() == 6 );
+        REQUIRE( v[0] == 4 );
+        REQUIRE( v[5] == 11 );
+    }
+
+    SECTION( "Optional setup is kept by copies and moves" ) {
+        REQUIRE( v.compactRatio() == 0.5f );
+        v.setCompactRatio(2.0f);
+        v.enableAddressIndex();
+        PtrList<int> c(v);
+        REQUIRE( c.compactRatio() == 2.0f );
+        REQUIRE( c.isAddressIndexed() );
+        REQUIRE( !c.isIndexed() );
+        REQUIRE( c.indexOfPtr(&c[1]) == 1 );
+        PtrList<int> a;
+        a.push_back(5);
+        a.enableIndex();
+        a = v;
+        REQUIRE( a.compactRatio() == 2.0f );
+        REQUIRE( a.isAddressIndexed() );
+        REQUIRE( !a.isIndexed() );
+        REQUIRE( a.size() == 6 );
+        REQUIRE( a.indexOfPtr(&a[4]) == 4 );
+        v.enableIndex();
+        a = v;
+        REQUIRE( a.isIndexed() );
+        REQUIRE( a.contains(8) );
+        REQUIRE( !a.contains(3) );
+        PtrList<int> m(std::move(c));
+        REQUIRE( m.compactRatio() == 2.0f );
+        REQUIRE( c.compactRatio() == 0.5f );
+        REQUIRE( !c.isAddressIndexed() );
+        // Heap storage and the optional state take no room in the list object
+        REQUIRE( sizeof(PtrList<int>) <= 7 * sizeof(void*) );
+    }
+
+    SECTION( "Clearing" ) {
+        v.clear();
+        REQUIRE( v.size() == 0 );
+        REQUIRE( v.removedCount() == 0 );
+        REQUIRE( v.begin() == v.end() );
+    }
+}
+
+TEST_CASE( "Copy-on-write sharing", "[PtrList]" )
+{
+    PtrList<int> src;
+    for(int i = 0; i < 10; i++)
+        src.push_back(i);
+
+    PtrListCow<PtrList<int> > a(std::move(src));
+    PtrListCow<PtrList<int> > b(a);
+    PtrListCow<PtrList<int> > c;
+    c = b;
+    REQUIRE( a.useCount() == 3 );
+    REQUIRE( &a.read() == &c.read() );
+    REQUIRE( &a.read()[5] == &b.read()[5] );
+
+    // Only the written holder gets a copy
+    const int *shared5 = &a.read()[5];
+    b.edit().push_back(10);
+    REQUIRE( b.size() == 11 );
+    REQUIRE( a.size() == 10 );
+    REQUIRE( !b.isShared() );
+    REQUIRE( a.useCount() == 2 );
+    REQUIRE( &b.read()[5] != shared5 );
+    REQUIRE( &a.read()[5] == shared5 );
+
+    // Not shared list is edited in place
+    int *own = &b.edit()[0];
+    b.edit()[0] = 100;
+    REQUIRE( &b.read()[0] == own );
+    REQUIRE( b.read()[0] == 100 );
+    REQUIRE( c.read()[0] == 0 );
+
+    int sum = 0;
+    for(const int &i : *c)
+        sum += i;
+    REQUIRE( sum == 45 );
+    REQUIRE( c->size() == 10 );
+
+    PtrListCow<PtrList<int> > moved(std::move(c));
+    REQUIRE( c.size() == 0 );
+    REQUIRE( moved.size() == 10 );
+    REQUIRE( a.useCount() == 2 );
+
+    // Lookups through read() skip holes and don't compact the shared list
+    a.edit().markRemoved(size_t(3));
+    const PtrList<int> &r = a.read();
+    REQUIRE( r.removedCount() == 1 );
+    REQUIRE( !r.contains(3) );
+    REQUIRE( r.contains(4) );
+    REQUIRE( r.indexOf(3) == -1 );
+    REQUIRE( r.indexOf(4) == 4 );
+    REQUIRE( *a->find(9) == 9 );
+    REQUIRE( a->find(3) == r.end() );
+    REQUIRE( r.removedCount() == 1 );
+
+    // Enabling of the index closes the hole, the element 6 at slot 5 is the next one
+    a.edit().enableIndex();
+    a.edit().markRemoved(size_t(5));
+    REQUIRE( a->contains(5) );
+    REQUIRE( !a->contains(6) );
+    REQUIRE( a->indexOf(6) == -1 );
+    REQUIRE( a->indexOf(7) == 6 );
+    REQUIRE( *a->find(8) == 8 );
+    REQUIRE( a->removedCount() == 1 );
+}
+
+// Copying of the element with value -1 fails
+struct CloneItem
+{
+    int v;
+    CloneItem(int i) : v(i) {}
+    CloneItem(const CloneItem &o) : v(o.v)
+    {
+        if(v == -1)
+            throw std::runtime_error("copy failed");
+    }
+};
+
+template<>
+struct PtrListThreadSafeCopy<CloneItem> : std::true_type {};
+
+template<>
+struct PtrListThreadSafeCopy<std::string> : std::true_type {};
+
+TEST_CASE( "Parallel clone", "[PtrList]" )
+{
+    PtrList<std::string> v;
+    for(int i = 0; i < 1000; i++)
+        v.push_back(std::to_string(i));
+
+    SECTION( "Elements are copied" ) {
+        PtrList<std::string> c = v.clone(4, 1);
+        REQUIRE( c.size() == 1000 );
+        for(size_t i = 0; i < c.size(); i++)
+        {
+            REQUIRE( c[i] == v[i] );
+            REQUIRE( &c[i] != &v[i] );
+        }
+        c.push_back("end");
+        REQUIRE( c.back() == "end" );
+    }
+
+    SECTION( "Small lists are copied sequentially" ) {
+        PtrList<std::string> c = v.clone(4);
+        REQUIRE( c.size() == 1000 );
+        REQUIRE( c[999] == "999" );
+    }
+
+    SECTION( "Holes are skipped" ) {
+        for(size_t i = 0; i < v.size(); i += 2)
+            v.markRemoved(i);
+        PtrList<std::string> c = v.clone(3, 1);
+        REQUIRE( c.size() == 500 );
+        REQUIRE( c.removedCount() == 0 );
+        REQUIRE( c[0] == "1" );
+        REQUIRE( c[499] == "999" );
+    }
+
+    SECTION( "Indices are rebuilt" ) {
+        v.enableIndex();
+        v.enableAddressIndex();
+        PtrList<std::string> c = v.clone(4, 1);
+        REQUIRE( c.contains("500") );
+        REQUIRE( c.indexOf("500") == 500 );
+        REQUIRE( c.indexOfPtr(&c[700]) == 700 );
+        REQUIRE( c.indexOfPtr(&v[700]) == -1 );
+    }
+
+    SECTION( "Slab storage" ) {
+        PtrList<int, PtrListSlabStorage<int, 16> > s;
+        for(int i = 0; i < 1000; i++)
+            s.push_back(i);
+        PtrList<int, PtrListSlabStorage<int, 16> > c = s.clone(4, 1);
+        REQUIRE( c.size() == 1000 );
+        for(size_t i = 0; i < c.size(); i++)
+            REQUIRE( c[i] == int(i) );
+        c.removeAt(10);
+        c.push_back(-1);
+        REQUIRE( c[10] == 11 );
+        REQUIRE( c.back() == -1 );
+    }
+
+    SECTION( "Failed copy" ) {
+        PtrList<CloneItem> f;
+        for(int i = 0; i < 1000; i++)
+            f.push_back(CloneItem(i));
+        f[700].v = -1;
+        REQUIRE_THROWS_AS( f.clone(4, 1), std::runtime_error );
+        PtrList<CloneItem, PtrListSlabStorage<CloneItem> > fs;
+        for(int i = 0; i < 1000; i++)
+            fs.push_back(CloneItem(i));
+        fs[300].v = -1;
+        REQUIRE_THROWS_AS( fs.clone(4, 1), std::runtime_error );
+        REQUIRE( f.size() == 1000 );
+    }
+}
+
+TEST_CASE( "Ownership transfer", "[PtrList]" )
+{
+    PtrList<std::string> a, b;
+    for(int i = 0; i < 10; i++)
+        a.push_back(std::to_string(i));
+    for(int i = 0; i < 5; i++)
+        b.push_back("b" + std::to_string(i));
+    const std::string *a3 = &a[3], *a4 = &a[4], *a5 = &a[5];
+
+    SECTION( "Splicing between lists" ) {
+        a.enableIndex();
+        b.enableIndex();
+        b.splice(1, a, 3, 6);
+        REQUIRE( a.size() == 7 );
+        REQUIRE( b.size() == 8 );
+        REQUIRE( a[3] == "6" );
+        REQUIRE( &b[1] == a3 );
+        REQUIRE( &b[2] == a4 );
+        REQUIRE( &b[3] == a5 );
+        REQUIRE( b[0] == "b0" );
+        REQUIRE( b[4] == "b1" );
+        REQUIRE( !a.contains("4") );
+        REQUIRE( b.contains("4") );
+        REQUIRE( b.indexOf("5") == 3 );
+        REQUIRE( b.indexOf("b4") == 7 );
+
+        b.splice(b.size(), a);
+        REQUIRE( a.size() == 0 );
+        REQUIRE( b.size() == 15 );
+        REQUIRE( b.back() == "9" );
+        a.push_back("new");
+        REQUIRE( a[0] == "new" );
+    }
+
+    SECTION( "Splicing inside of the list" ) {
+        a.splice(0, a, 3, 6);
+        REQUIRE( &a[0] == a3 );
+        REQUIRE( &a[2] == a5 );
+        REQUIRE( a[3] == "0" );
+        REQUIRE( a[6] == "6" );
+        a.splice(a.size(), a, 0, 3);
+        REQUIRE( &a[9] == a5 );
+        REQUIRE( a[0] == "0" );
+        REQUIRE( a[6] == "9" );
+        a.splice(1, a, 0, 3);
+        REQUIRE( a[0] == "0" );
+        REQUIRE( a.size() == 10 );
+    }
+
+    SECTION( "Taking and adopting" ) {
+        a.enableAddressIndex();
+        REQUIRE( a.indexOfPtr(a5) == 5 );
+        std::unique_ptr<std::string> taken(a.takeAt(3));
+        REQUIRE( taken.get() == a3 );
+        REQUIRE( a.size() == 9 );
+        REQUIRE( a.indexOfPtr(a3) == -1 );
+        REQUIRE( a.indexOfPtr(a5) == 4 );
+
+        std::string *released = a.release(3);
+        REQUIRE( released == a4 );
+        REQUIRE( a[3] == "5" );
+
+        b.adopt(released);
+        b.adopt(0, taken.release());
+        REQUIRE( b.size() == 7 );
+        REQUIRE( &b[0] == a3 );
+        REQUIRE( &b.back() == a4 );
+        b.adopt(std::unique_ptr<std::string>(new std::string("own")));
+        REQUIRE( b.back() == "own" );
+    }
+
+    SECTION( "Holes are skipped" ) {
+        a.markRemoved(size_t(1));
+        a.markRemoved(size_t(4));
+        b.splice(0, a, 3, 6);
+        REQUIRE( b.size() == 7 );
+        REQUIRE( &b[0] == a3 );
+        REQUIRE( &b[1] == a5 );
+        REQUIRE( a.size() == 6 );
+        REQUIRE( a.removedCount() == 0 );
+        REQUIRE( a[1] == "2" );
+        REQUIRE( a[2] == "6" );
+    }
+}
+
+TEST_CASE( "Pointer array adoption", "[PtrList]" )
+{
+    PtrList<std::string> a;
+    for(int i = 0; i < 10; i++)
+        a.push_back(std::to_string(i));
+    a.pop_front();
+    a.markRemoved(size_t(2));
+    const std::string *s5 = &a[4];
+    a.enableIndex();
+
+    size_t num = 0;
+    std::string **data = a.takeStorage(num);
+    REQUIRE( num == 8 );
+    REQUIRE( data[3] == s5 );
+    REQUIRE( *data[0] == "1" );
+    REQUIRE( data[num] == nullptr );
+    REQUIRE( a.size() == 0 );
+    REQUIRE( !a.contains("5") );
+    a.push_back("new");
+    REQUIRE( a.size() == 1 );
+
+    PtrList<std::string> b;
+    b.enableIndex();
+    b.push_back("old");
+    b.adoptStorage(data, num, num + 1);
+    REQUIRE( b.size() == 8 );
+    REQUIRE( &b[3] == s5 );
+    REQUIRE( b.indexOf("5") == 3 );
+    REQUIRE( !b.contains("old") );
+    b.push_back("10");
+    b.push_front("0");
+    REQUIRE( b.size() == 10 );
+    REQUIRE( b.back() == "10" );
+
+    size_t none = 1;
+    PtrList<std::string> empty;
+    REQUIRE( empty.takeStorage(none) == nullptr );
+    REQUIRE( none == 0 );
+
+    // Reserved array of the empty list is terminated too
+    PtrList<std::string> reserved;
+    reserved.reserve(4);
+    data = reserved.takeStorage(none);
+    REQUIRE( none == 0 );
+    REQUIRE( data != nullptr );
+    REQUIRE( data[0] == nullptr );
+    free(data);
+    SmallPtrList<std::string, 4> small;
+    small.reserve(2);
+    data = small.takeStorage(none);
+    REQUIRE( data[0] == nullptr );
+    free(data);
+}
+
+TEST_CASE( "Small buffer", "[PtrList]" )
+{
+    typedef SmallPtrList<std::string, 4> Small;
+    Small a;
+    for(int i = 0; i < 4; i++)
+        a.push_back(std::to_string(i));
+    const std::string *a2 = &a[2];
+    REQUIRE( a.reallocations() == 0 );
+    REQUIRE( a.memoryUsage().pointerArray == 0 );
+    REQUIRE( a.capacity() == 4 );
+
+    SECTION( "Spilling to the heap" ) {
+        a.push_back("4");
+        REQUIRE( a.reallocations() == 1 );
+        REQUIRE( a.memoryUsage().pointerArray > 0 );
+        REQUIRE( &a[2] == a2 );
+        for(int i = 5; i < 100; i++)
+            a.push_back(std::to_string(i));
+        REQUIRE( a[99] == "99" );
+
+        a.removeAt(3, 97);
+        a.shrink_to_fit();
+        REQUIRE( a.size() == 3 );
+        REQUIRE( a.memoryUsage().pointerArray == 0 );
+        REQUIRE( &a[2] == a2 );
+        a.push_back("end");
+        REQUIRE( a[3] == "end" );
+    }
+
+    SECTION( "Front operations" ) {
+        a.pop_front();
+        a.push_front("first");
+        REQUIRE( a.size() == 4 );
+        REQUIRE( a[0] == "first" );
+        a.push_front("zero");
+        REQUIRE( a.size() == 5 );
+        REQUIRE( a[0] == "zero" );
+        REQUIRE( &a[3] == a2 );
+        a.insert(2, "middle");
+        a.removeAt(0);
+        REQUIRE( a[1] == "middle" );
+    }
+
+    SECTION( "Swapping and moving" ) {
+        Small b, c;
+        b.push_back("b");
+        for(int i = 0; i < 10; i++)
+            c.push_back("c");
+        a.swap(b);
+        REQUIRE( a.size() == 1 );
+        REQUIRE( b.size() == 4 );
+        REQUIRE( &b[2] == a2 );
+        b.swap(c);
+        REQUIRE( b.size() == 10 );
+        REQUIRE( c.size() == 4 );
+        REQUIRE( &c[2] == a2 );
+        c.push_back("4");
+        REQUIRE( c[4] == "4" );
+
+        Small m(std::move(c));
+        REQUIRE( c.size() == 0 );
+        REQUIRE( m.size() == 5 );
+        REQUIRE( &m[2] == a2 );
+        a = std::move(m);
+        REQUIRE( a.size() == 5 );
+        REQUIRE( &a[2] == a2 );
+        c.push_back("c");
+        REQUIRE( c.size() == 1 );
+    }
+
+    SECTION( "Copying" ) {
+        Small b(a);
+        REQUIRE( b.size() == 4 );
+        REQUIRE( b.reallocations() == 0 );
+        REQUIRE( b[2] == "2" );
+        Small c = a.clone(2, 1);
+        REQUIRE( c.size() == 4 );
+        REQUIRE( c[3] == "3" );
+        c = b;
+        REQUIRE( c[0] == "0" );
+    }
+
+    SECTION( "Holes and transfers" ) {
+        a.markRemoved(size_t(1));
+        a.push_back("4");
+        REQUIRE( a.size() == 5 );
+        Small b;
+        // Slot positions, the hole is skipped
+        b.splice(0, a, 0, 3);
+        REQUIRE( b.size() == 2 );
+        REQUIRE( &b[1] == a2 );
+        REQUIRE( a.size() == 2 );
+        REQUIRE( a[0] == "3" );
+
+        size_t num = 0;
+        std::string **data = b.takeStorage(num);
+        REQUIRE( num == 2 );
+        REQUIRE( data[1] == a2 );
+        PtrList<std::string> p;
+        p.adoptStorage(data, num, num + 1);
+        REQUIRE( p[0] == "0" );
+    }
+
+    SECTION( "Clearing" ) {
+        a.clear();
+        REQUIRE( a.size() == 0 );
+        a.push_back("x");
+        REQUIRE( a.reallocations() == 0 );
+        REQUIRE( a[0] == "x" );
+    }
+}
@@ -0,0 +1,235 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#include <catch/catch.hpp>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../segptrlist.h"
+
+template<class List>
+static bool sameAs(const List &l, const std::vector<int> &model)
+{
+    if(l.size() != model.size())
+        return false;
+    for(size_t i = 0; i < model.size(); i++)
+    {
+        if(l[i] != model[i])
+            return false;
+    }
+    return true;
+}
+
+TEST_CASE( "Adding and removing items", "[SegPtrList]" )
+{
+    SegPtrList<int> v;
+    std::vector<int> model;
+
+    for(int i = 0; i < 100; i++)
+    {
+        v.push_back(i);
+        model.push_back(i);
+    }
+    REQUIRE( sameAs(v, model) );
+
+    SECTION( "Front and back" ) {
+        v.push_front(-1);
+        model.insert(model.begin(), -1);
+        v.pop_back();
+        model.pop_back();
+        v.pop_front();
+        model.erase(model.begin());
+        REQUIRE( sameAs(v, model) );
+        REQUIRE( v.first() == 0 );
+        REQUIRE( v.last() == 98 );
+    }
+
+    SECTION( "Ranges" ) {
+        v.removeAt(10, 30);
+        model.erase(model.begin() + 10, model.begin() + 40);
+        REQUIRE( sameAs(v, model) );
+        v.erase(v.begin() + 5, v.end());
+        model.erase(model.begin() + 5, model.end());
+        REQUIRE( sameAs(v, model) );
+    }
+
+    SECTION( "Search and removal by value" ) {
+        v.push_back(5);
+        REQUIRE( v.contains(5) );
+        REQUIRE( !v.contains(500) );
+        REQUIRE( v.indexOf(5) == 5 );
+        REQUIRE( v.lastIndexOf(5) == 100 );
+        REQUIRE( v.removeAll(5) == 2 );
+        REQUIRE( v.removeOne(6) );
+        REQUIRE( !v.removeOne(6) );
+        REQUIRE( v.removeIf([](const int &i) { return i % 2 == 0; }) == 49 );
+        REQUIRE( v.size() == 49 );
+        REQUIRE( v[0] == 1 );
+        REQUIRE( v[48] == 99 );
+    }
+
+    SECTION( "Throwing predicate" ) {
+        REQUIRE_THROWS_AS( v.removeIf([](const int &i)
+        {
+            if(i == 50)
+                throw std::runtime_error("predicate failed");
+            return i % 2 == 0;
+        }), std::runtime_error );
+        // Matches before the failure are removed, the rest is kept
+        REQUIRE( v.size() == 75 );
+        REQUIRE( v[0] == 1 );
+        REQUIRE( v[24] == 49 );
+        REQUIRE( v[25] == 50 );
+        REQUIRE( v[74] == 99 );
+        v.push_back(100);
+        REQUIRE( v.back() == 100 );
+    }
+
+    SECTION( "Unordered removal" ) {
+        int *last = &v[99];
+        v.removeAtUnordered(10);
+        REQUIRE( &v[10] == last );
+        REQUIRE( v.removeOneUnordered(20) );
+        REQUIRE( v[20] == 98 );
+        REQUIRE( v.removeIfUnordered([](const int &i) { return i >= 90; }) == 10 );
+        REQUIRE( v.size() == 88 );
+        REQUIRE( !v.contains(95) );
+    }
+
+    SECTION( "Clear and reuse" ) {
+        v.clear();
+        REQUIRE( v.empty() );
+        v.push_back(7);
+        REQUIRE( v.size() == 1 );
+        REQUIRE( v[0] == 7 );
+    }
+}
+
+TEST_CASE( "Random operations against std::vector", "[SegPtrList]" )
+{
+    SegPtrList<int> v;
+    std::vector<int> model;
+    unsigned seed = 12345;
+    auto rnd = [&seed]() { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+
+    bool same = true;
+    for(int step = 0; step < 40000; step++)
+    {
+        unsigned op = rnd() % 10;
+        size_t at = model.empty() ? 0 : rnd() % (model.size() + 1);
+        if(op < 6 || model.empty())
+        {
+            v.insert(at, step);
+            model.insert(model.begin() + at, step);
+        }
+        else if(op < 9)
+        {
+            if(at == model.size())
+                at--;
+            v.removeAt(at);
+            model.erase(model.begin() + at);
+        }
+        else
+        {
+            size_t to = rnd() % model.size();
+            if(at == model.size())
+                at--;
+            v.move(at, to);
+            int x = model[at];
+            model.erase(model.begin() + at);
+            model.insert(model.begin() + to, x);
+        }
+        if(step % 1000 == 0)
+            same = same && sameAs(v, model);
+    }
+    REQUIRE( sameAs(v, model) );
+    REQUIRE( same );
+    // Block size follows the size
+    REQUIRE( v.blockSlots() * v.blockSlots() * 4 >= v.size() );
+
+    while(model.size() > 10)
+    {
+        size_t at = rnd() % model.size();
+        v.removeAt(at);
+        model.erase(model.begin() + at);
+    }
+    REQUIRE( sameAs(v, model) );
+    REQUIRE( v.blockSlots() == 16 );
+}
+
+TEST_CASE( "Addresses of elements are persistent", "[SegPtrList]" )
+{
+    SegPtrList<std::string> v;
+    for(int i = 0; i < 5000; i++)
+        v.push_back(std::to_string(i));
+
+    std::string *p = &v[2500];
+    for(int i = 0; i < 5000; i++)
+        v.insert(size_t(i * 7 % 2500), "x");
+    for(int i = 0; i < 2000; i++)
+        v.removeAt(v.size() - 1);
+
+    ssize_t at = v.indexOf("2500");
+    REQUIRE( at >= 0 );
+    REQUIRE( &v[size_t(at)] == p );
+}
+
+TEST_CASE( "Iterators, sorting, copying and moving", "[SegPtrList]" )
+{
+    SegPtrList<int> v;
+    std::vector<int> model;
+    for(int i = 0; i < 3000; i++)
+    {
+        int x = (i * 7919) % 3001;
+        v.push_back(x);
+        model.push_back(x);
+    }
+
+    SECTION( "Iterators" ) {
+        long long sum = 0, expected = 0;
+        for(int &i : v)
+            sum += i;
+        for(int i : model)
+            expected += i;
+        REQUIRE( sum == expected );
+        const SegPtrList<int> &c = v;
+        REQUIRE( std::find(c.begin(), c.end(), model[100]) - c.begin() == 100 );
+        REQUIRE( *(v.begin() + 10) == model[10] );
+        REQUIRE( v.end() - v.begin() == 3000 );
+    }
+
+    SECTION( "Sorting" ) {
+        int *first = &v[0];
+        v.sort();
+        std::sort(model.begin(), model.end());
+        REQUIRE( sameAs(v, model) );
+        v.stable_sort(std::greater<int>());
+        std::stable_sort(model.begin(), model.end(), std::greater<int>());
+        REQUIRE( sameAs(v, model) );
+        REQUIRE( v.contains(*first) );
+        REQUIRE( &v[size_t(v.indexOf(*first))] == first );
+    }
+
+    SECTION( "Copying and moving" ) {
+        SegPtrList<int> c(v);
+        REQUIRE( c == v );
+        REQUIRE( &c[0] != &v[0] );
+        int *first = &v[0];
+        SegPtrList<int> m(std::move(v));
+        REQUIRE( v.size() == 0 );
+        REQUIRE( &m[0] == first );
+        REQUIRE( sameAs(m, model) );
+        v = c;
+        REQUIRE( sameAs(v, model) );
+        c = std::move(m);
+        REQUIRE( sameAs(c, model) );
+    }
+
+    SECTION( "Slab storage" ) {
+        SegPtrList<int, PtrListSlabStorage<int, 64> > s;
+        for(int i = 0; i < 1000; i++)
+            s.insert(size_t(i / 2), i);
+        REQUIRE( s.size() == 1000 );
+        REQUIRE( s.storage().pagesCount() == 16 );
+        s.clear();
+        REQUIRE( s.storage().pagesCount() == 0 );
+    }
+}
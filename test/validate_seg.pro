@@ -0,0 +1,24 @@
+TEMPLATE = app
+CONFIG += console c++11 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+QMAKE_CXXFLAGS_RELEASE += -Ofast
+QMAKE_CFLAGS_RELEASE += -march=native
+QMAKE_CXXFLAGS_RELEASE += -march=native
+QMAKE_CXXFLAGS_RELEASE += -static-libgcc -static-libstdc++
+
+DESTDIR = $$PWD/bin
+#DEFINES += INIDEBUG
+
+include(catch/catch.pri)
+
+SOURCES += \
+    validate_seg.cpp
+
+HEADERS += \
+    ../segptrlist.h \
+    ../ptrlist.h \
+    ../ptrlist_index.h \
+    ../ptrlist_sort.h \
+    ../ptrlist_stats.h
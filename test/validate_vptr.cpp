@@ -1,10 +1,17 @@
 #define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
 #include <catch/catch.hpp>
+#include <stdlib.h>
+#include <memory>
+#include <new>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include "../vptrlist.h"
+#include "../ptrlist_cow.h"
+#include "../ptrlist_convert.h"
 
-TEST_CASE( "vectors can be sized and resized", "[PtrList]" )
+TEST_CASE( "vectors can be sized and resized", "[VPtrList]" )
 {
     VPtrList<int> v( 5 );
 
@@ -39,7 +46,7 @@ TEST_CASE( "vectors can be sized and resized", "[PtrList]" )
 }
 
 
-TEST_CASE( "Adding and removing items", "[PtrList]" )
+TEST_CASE( "Adding and removing items", "[VPtrList]" )
 {
     VPtrList<int> v;
     REQUIRE( v.size() == 0 );
@@ -243,3 +250,1113 @@ TEST_CASE( "Adding and removing items", "[PtrList]" )
         REQUIRE( copypasta.size() == 0 );
     }
 }
+
+static size_t g_countingAllocated = 0;
+static size_t g_countingReleased = 0;
+
+template<class T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    CountingAllocator() {}
+    template<class U>
+    CountingAllocator(const CountingAllocator<U> &) {}
+
+    T *allocate(size_t n)
+    {
+        g_countingAllocated += n;
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        g_countingReleased += n;
+        ::operator delete(p);
+    }
+};
+
+template<class T, class U>
+bool operator==(const CountingAllocator<T> &, const CountingAllocator<U> &) { return true; }
+template<class T, class U>
+bool operator!=(const CountingAllocator<T> &, const CountingAllocator<U> &) { return false; }
+
+TEST_CASE( "Elements are allocated through the allocator", "[VPtrList]" )
+{
+    g_countingAllocated = 0;
+    g_countingReleased = 0;
+
+    {
+        VPtrList<std::string, CountingAllocator<std::string> > v;
+        v.reserve(10);
+        size_t vectorAllocated = g_countingAllocated;
+
+        v.push_back("one");
+        v.emplace_back("two");
+        v.append(std::string("three"));
+        v.insert(0, "zero");
+        v.push_front("minus one");
+        REQUIRE( v.size() == 5 );
+        REQUIRE( v[0] == "minus one" );
+        REQUIRE( v[4] == "three" );
+        REQUIRE( g_countingAllocated - vectorAllocated == 5 );
+
+        v.removeAt(1);
+        v.pop_back();
+        REQUIRE( v.size() == 3 );
+        REQUIRE( g_countingReleased == 2 );
+
+        VPtrList<std::string, CountingAllocator<std::string> > copy = v;
+        REQUIRE( copy.size() == 3 );
+        REQUIRE( copy[2] == "two" );
+
+        v.resize(5);
+        REQUIRE( v[4].empty() );
+    }
+
+    REQUIRE( g_countingAllocated == g_countingReleased );
+    // Stateless allocator isn't stored into every slot
+    REQUIRE( sizeof(VPtrList<std::string, CountingAllocator<std::string> >::SHptr) == sizeof(std::string*) );
+}
+
+TEST_CASE( "Double-ended operations", "[VPtrList]" )
+{
+    VPtrList<int> v;
+
+    SECTION( "push_front and pop_front don't shift the array" ) {
+        for(int i = 0; i < 1000; i++)
+            v.push_front(i);
+        REQUIRE( v.size() == 1000 );
+        REQUIRE( v.first() == 999 );
+        REQUIRE( v.last() == 0 );
+        REQUIRE( v.at(999) == 0 );
+
+        int *addr = &v[500];
+        for(int i = 0; i < 500; i++)
+            v.pop_front();
+        REQUIRE( v.size() == 500 );
+        REQUIRE( &v[0] == addr );
+        REQUIRE( v[0] == 499 );
+        REQUIRE( *v.begin() == 499 );
+        REQUIRE( v.indexOf(0) == 499 );
+
+        v.push_back(-1);
+        v.insert(1, -2);
+        REQUIRE( v[0] == 499 );
+        REQUIRE( v[1] == -2 );
+        REQUIRE( v[2] == 498 );
+        REQUIRE( v.last() == -1 );
+
+        v.removeAt(1);
+        REQUIRE( v[1] == 498 );
+        REQUIRE( v.size() == 501 );
+
+        int sum = 0;
+        for(int &i : v)
+            sum += i;
+        REQUIRE( sum == 124750 - 1 );
+    }
+
+    SECTION( "Queue usage doesn't grow the array forever" ) {
+        for(int i = 0; i < 100000; i++)
+        {
+            v.push_back(i);
+            if(v.size() > 10)
+                v.pop_front();
+        }
+        REQUIRE( v.size() == 10 );
+        REQUIRE( v.first() == 99990 );
+        REQUIRE( v.capacity() < 100 );
+        v.shrink_to_fit();
+        REQUIRE( v.first() == 99990 );
+        REQUIRE( v.size() == 10 );
+    }
+
+    SECTION( "Removal of front items" ) {
+        for(int i = 0; i < 10; i++)
+            v.push_back(i);
+        v.erase(v.begin() + 1, v.begin() + 4);
+        REQUIRE( v.size() == 7 );
+        REQUIRE( v[0] == 0 );
+        REQUIRE( v[1] == 4 );
+        while(!v.empty())
+            v.pop_front();
+        v.push_front(5);
+        v.push_front(6);
+        REQUIRE( v[0] == 6 );
+        REQUIRE( v[1] == 5 );
+    }
+
+    SECTION( "Headroom slots are out of range" ) {
+        v.push_back(1);
+        v.push_front(0);
+        REQUIRE( v.at(0) == 0 );
+        REQUIRE( v.at(1) == 1 );
+        REQUIRE_THROWS_AS( v.at(-1), std::out_of_range );
+        REQUIRE_THROWS_AS( v.at(-1L), std::out_of_range );
+        REQUIRE_THROWS_AS( v.at(2u), std::out_of_range );
+        const VPtrList<int> &c = v;
+        REQUIRE_THROWS_AS( c.at(-1), std::out_of_range );
+        REQUIRE_THROWS_AS( c.at(2), std::out_of_range );
+    }
+}
+
+TEST_CASE( "Removal by predicate", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    for(int i = 0; i < 20; i++)
+        v.push_back(i % 5);
+
+    int *kept = &v[1];
+
+    REQUIRE( v.removeAll(3) == 4 );
+    REQUIRE( v.size() == 16 );
+    REQUIRE( &v[1] == kept );
+    REQUIRE_FALSE( v.contains(3) );
+    REQUIRE( v.removeAll(42) == 0 );
+    REQUIRE( v.size() == 16 );
+
+    REQUIRE( v.removeOne(4) );
+    REQUIRE_FALSE( v.removeOne(42) );
+    REQUIRE( v.size() == 15 );
+    REQUIRE( v[3] == 0 );
+
+    REQUIRE( v.removeOneIf([](const int &i) { return i == 2; }) );
+    REQUIRE( v.size() == 14 );
+    REQUIRE( v[0] == 0 );
+    REQUIRE( v[1] == 1 );
+    REQUIRE( v[2] == 0 );
+
+    REQUIRE( v.removeIf([](const int &i) { return i % 2 == 0; }) == 10 );
+    REQUIRE( v.size() == 4 );
+    for(size_t i = 0; i < v.size(); i++)
+        REQUIRE( v[i] == 1 );
+    REQUIRE( &v[0] == kept );
+
+    REQUIRE( v.removeIf([](const int &) { return true; }) == 4 );
+    REQUIRE( v.size() == 0 );
+    v.push_back(7);
+    REQUIRE( v[0] == 7 );
+}
+
+TEST_CASE( "Removal by throwing predicate", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    for(int i = 0; i < 20; i++)
+        v.push_back(i);
+    v.pop_front();
+    v.enableIndex();
+
+    REQUIRE_THROWS_AS( v.removeIf([](const int &i)
+    {
+        if(i == 10)
+            throw std::runtime_error("predicate failed");
+        return i % 2 == 0;
+    }), std::runtime_error );
+
+    // Matches before the failure are removed, the rest is kept
+    REQUIRE( v.size() == 15 );
+    REQUIRE( v[0] == 1 );
+    REQUIRE( v[4] == 9 );
+    REQUIRE( v[5] == 10 );
+    REQUIRE( v[14] == 19 );
+    REQUIRE( !v.contains(4) );
+    REQUIRE( v.indexOf(12) == 7 );
+    int sum = 0;
+    for(int &i : v)
+        sum += i;
+    REQUIRE( sum == 25 + 145 );
+    REQUIRE( v.removeIf([](const int &i) { return i >= 10; }) == 10 );
+    REQUIRE( v.size() == 5 );
+}
+
+struct IndexedItem
+{
+    int id;
+    std::string name;
+    bool operator==(const IndexedItem &o) const
+    {
+        return id == o.id && name == o.name;
+    }
+};
+
+TEST_CASE( "Hash index of elements", "[VPtrList]" )
+{
+    SECTION( "Index by value" ) {
+        VPtrList<int> v;
+        for(int i = 0; i < 1000; i++)
+            v.push_back(i);
+        v.enableIndex();
+        REQUIRE( v.isIndexed() );
+
+        REQUIRE( v.contains(500) );
+        REQUIRE_FALSE( v.contains(1000) );
+        REQUIRE( v.indexOf(500) == 500 );
+        REQUIRE( v.indexOf(1000) == -1 );
+
+        v.push_back(1000);
+        v.push_back(500);
+        REQUIRE( v.contains(1000) );
+        REQUIRE( v.indexOf(1000) == 1000 );
+        REQUIRE( v.indexOf(500) == 500 );
+
+        v.insert(10, 2000);
+        REQUIRE( v.indexOf(2000) == 10 );
+        REQUIRE( v.indexOf(500) == 501 );
+        REQUIRE( v.indexOf(999) == 1000 );
+
+        v.removeAt(5);
+        REQUIRE( v.indexOf(500) == 500 );
+        REQUIRE_FALSE( v.contains(5) );
+
+        v.swap(0, 1);
+        REQUIRE( v.indexOf(0) == 1 );
+        REQUIRE( v.indexOf(1) == 0 );
+
+        v.move(2, 998);
+        REQUIRE( v.indexOf(2) == 998 );
+        REQUIRE( v.indexOf(3) == 2 );
+
+        v.push_front(-1);
+        REQUIRE( v.indexOf(-1) == 0 );
+        REQUIRE( v.indexOf(3) == 3 );
+        v.pop_front();
+        REQUIRE_FALSE( v.contains(-1) );
+
+        REQUIRE( v.removeAll(500) == 2 );
+        REQUIRE_FALSE( v.contains(500) );
+        REQUIRE( v.removeAll(500) == 0 );
+        REQUIRE( v.removeOne(999) );
+        REQUIRE_FALSE( v.removeOne(999) );
+        REQUIRE( *v.find(1000) == 1000 );
+        REQUIRE( v.find(999) == v.end() );
+
+        VPtrList<int> copy = v;
+        REQUIRE( copy.isIndexed() );
+        REQUIRE( copy.indexOf(1000) == v.indexOf(1000) );
+
+        v.clear();
+        REQUIRE_FALSE( v.contains(1000) );
+        v.disableIndex();
+        REQUIRE_FALSE( v.isIndexed() );
+    }
+
+    SECTION( "Index by key" ) {
+        VPtrList<IndexedItem> v;
+        v.enableIndex([](const IndexedItem &i) { return i.id; });
+        v.push_back({1, "one"});
+        v.push_back({2, "two"});
+        v.push_back({2, "another two"});
+
+        REQUIRE( v.contains({2, "another two"}) );
+        REQUIRE_FALSE( v.contains({2, "three"}) );
+        REQUIRE( v.indexOf({2, "another two"}) == 2 );
+
+        v[1].name = "changed";
+        v.reindex();
+        REQUIRE( v.indexOf({2, "changed"}) == 1 );
+    }
+}
+
+// Allocations fail after this count of them while it's set, so an operation can be failed at any step
+static bool g_failAllocations = false;
+static size_t g_allocationsLeft = 0;
+
+void *operator new(size_t size)
+{
+    void *p = nullptr;
+    if(!g_failAllocations || g_allocationsLeft-- > 0)
+        p = malloc(size ? size : 1);
+    if(!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    try
+    {
+        return operator new(size);
+    }
+    catch(const std::bad_alloc &)
+    {
+        return nullptr;
+    }
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    free(p);
+}
+
+template<class Op>
+static bool failsToAllocate(size_t allowed, Op op)
+{
+    bool failed = false;
+    g_failAllocations = true;
+    g_allocationsLeft = allowed;
+    try
+    {
+        op();
+    }
+    catch(const std::bad_alloc &)
+    {
+        failed = true;
+    }
+    g_failAllocations = false;
+    return failed;
+}
+
+TEST_CASE( "Failed adoption leaves the index untouched", "[VPtrList]" )
+{
+    VPtrList<std::string> v;
+    v.enableIndex();
+    v.push_back("0");
+    while(v.size() < v.capacity())
+        v.push_back(std::to_string(v.size()));
+    size_t size = v.size();
+
+    // The pointer array is full, so the store has to grow it: the first
+    // allocation fails the store, the second one fails the indexing
+    for(size_t allowed = 0; allowed < 2; allowed++)
+    {
+        std::unique_ptr<std::string> own(new std::string("own"));
+        REQUIRE( failsToAllocate(allowed, [&]() { v.adopt(std::move(own)); }) );
+        REQUIRE( v.size() == size );
+        REQUIRE( !v.contains("own") );
+
+        own.reset(new std::string("front"));
+        REQUIRE( failsToAllocate(allowed, [&]() { v.adopt(0, std::move(own)); }) );
+        REQUIRE( v.size() == size );
+        REQUIRE( !v.contains("front") );
+        REQUIRE( v[0] == "0" );
+
+        REQUIRE( failsToAllocate(allowed, [&]() { v.push_back("back"); }) );
+        REQUIRE( v.size() == size );
+        REQUIRE( !v.contains("back") );
+    }
+
+    v.adopt(new std::string("own"));
+    v.adopt(0, new std::string("front"));
+    REQUIRE( v.size() == size + 2 );
+    REQUIRE( v.indexOf("own") == ssize_t(size + 1) );
+    REQUIRE( v.indexOf("front") == 0 );
+    REQUIRE( v.indexOf("0") == 1 );
+}
+
+TEST_CASE( "Sorting of pointers", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    const int values[] = {42, 7, 13, 7, -5, 100, 0, 13, 8, 1};
+    for(int i : values)
+        v.push_back(i);
+
+    std::vector<int*> addresses;
+    for(size_t i = 0; i < v.size(); i++)
+        addresses.push_back(&v[i]);
+
+    SECTION( "sort keeps addresses of elements" ) {
+        v.sort();
+        for(size_t i = 1; i < v.size(); i++)
+            REQUIRE( v[i - 1] <= v[i] );
+        REQUIRE( v[0] == -5 );
+        REQUIRE( &v[0] == addresses[4] );
+        REQUIRE( &v[v.size() - 1] == addresses[5] );
+
+        v.sort(std::greater<int>());
+        REQUIRE( v[0] == 100 );
+        REQUIRE( v[9] == -5 );
+    }
+
+    SECTION( "stable_sort keeps order of equal elements" ) {
+        v.stable_sort([](const int &a, const int &b) { return (a & 1) < (b & 1); });
+        REQUIRE( &v[0] == addresses[0] );
+        REQUIRE( &v[1] == addresses[5] );
+        REQUIRE( &v[2] == addresses[6] );
+        REQUIRE( &v[3] == addresses[8] );
+        REQUIRE( &v[4] == addresses[1] );
+        REQUIRE( &v[5] == addresses[2] );
+        REQUIRE( &v[6] == addresses[3] );
+        REQUIRE( &v[7] == addresses[4] );
+    }
+
+    SECTION( "partial_sort and nth_element" ) {
+        v.partial_sort(3);
+        REQUIRE( v[0] == -5 );
+        REQUIRE( v[1] == 0 );
+        REQUIRE( v[2] == 1 );
+
+        v.nth_element(9);
+        REQUIRE( v[9] == 100 );
+        v.nth_element(4, std::greater<int>());
+        REQUIRE( v[4] == 8 );
+    }
+
+    SECTION( "sorting keeps the index valid" ) {
+        v.enableIndex();
+        REQUIRE( v.indexOf(100) == 5 );
+        v.sort();
+        REQUIRE( v.indexOf(100) == 9 );
+        REQUIRE( v.indexOf(-5) == 0 );
+    }
+}
+
+TEST_CASE( "Parallel sort", "[VPtrList]" )
+{
+    VPtrList<int> v, w;
+    unsigned seed = 12345;
+    for(int i = 0; i < 100000; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int val = int((seed >> 16) % 1000);
+        v.push_back(val);
+        w.push_back(val);
+    }
+
+    std::vector<int*> before;
+    for(size_t i = 0; i < v.size(); i++)
+        before.push_back(&v[i]);
+
+    auto byTens = [](const int &a, const int &b) { return a / 10 < b / 10; };
+
+    SECTION( "Result is identical to stable_sort" ) {
+        v.parallel_sort(byTens, 3, 1000);
+        w.stable_sort(byTens);
+        REQUIRE( v.size() == w.size() );
+        bool same = true;
+        for(size_t i = 0; i < v.size(); i++)
+            same = same && (v[i] == w[i]);
+        REQUIRE( same );
+
+        // Only pointers are moved
+        std::vector<int*> after;
+        for(size_t i = 0; i < v.size(); i++)
+            after.push_back(&v[i]);
+        std::sort(before.begin(), before.end());
+        std::sort(after.begin(), after.end());
+        REQUIRE( before == after );
+    }
+
+    SECTION( "Small lists are sorted sequentially" ) {
+        VPtrList<int> s;
+        s.push_back(3);
+        s.push_back(1);
+        s.push_back(2);
+        s.parallel_sort(std::less<int>(), 8);
+        REQUIRE( s[0] == 1 );
+        REQUIRE( s[1] == 2 );
+        REQUIRE( s[2] == 3 );
+    }
+}
+
+struct SortItem
+{
+    int id;
+    float z;
+    std::string name;
+};
+
+TEST_CASE( "Sorting by cached keys", "[VPtrList]" )
+{
+    VPtrList<SortItem> v;
+    unsigned seed = 777;
+    for(int i = 0; i < 5000; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        int r = int((seed >> 16) % 2000) - 1000;
+        v.push_back({r, float(r) * 0.25f, std::to_string(r % 37)});
+    }
+
+    std::vector<SortItem*> before;
+    for(size_t i = 0; i < v.size(); i++)
+        before.push_back(&v[i]);
+
+    SECTION( "Integral key by radix sort is stable" ) {
+        VPtrList<SortItem> w = v;
+        v.sortByKey([](const SortItem &i) { return i.id / 16; });
+        w.stable_sort([](const SortItem &a, const SortItem &b) { return a.id / 16 < b.id / 16; });
+        bool same = true;
+        for(size_t i = 0; i < v.size(); i++)
+            same = same && (v[i].id == w[i].id);
+        REQUIRE( same );
+        REQUIRE( v[0].id < 0 );
+    }
+
+    SECTION( "Floating point key" ) {
+        v.sortByKey([](const SortItem &i) { return -i.z; });
+        bool sorted = true;
+        for(size_t i = 1; i < v.size(); i++)
+            sorted = sorted && (v[i - 1].z >= v[i].z);
+        REQUIRE( sorted );
+    }
+
+    SECTION( "Non-arithmetic key" ) {
+        v.sortByKey([](const SortItem &i) { return i.name; });
+        bool sorted = true;
+        for(size_t i = 1; i < v.size(); i++)
+            sorted = sorted && (v[i - 1].name <= v[i].name);
+        REQUIRE( sorted );
+    }
+
+    std::vector<SortItem*> after;
+    for(size_t i = 0; i < v.size(); i++)
+        after.push_back(&v[i]);
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    REQUIRE( before == after );
+}
+
+TEST_CASE( "Counters are compiled out by default", "[VPtrList]" )
+{
+    // Counters take no room in the list object
+    REQUIRE( std::is_empty<PtrListCounters>::value );
+    REQUIRE( sizeof(VPtrList<int>) == sizeof(std::vector<std::unique_ptr<int> >) + 3 * sizeof(void*) );
+    VPtrList<int> v;
+    for(int i = 0; i < 100; i++)
+        v.push_back(i);
+    v.removeAll(5);
+    REQUIRE( v.stats().allocations == 0 );
+    REQUIRE( v.stats().comparisons == 0 );
+    REQUIRE( v.stats().reallocations == 0 );
+    REQUIRE( v.reallocations() == 0 );
+    REQUIRE( PtrListCounters::globalStats().allocations == 0 );
+}
+
+TEST_CASE( "Index positions after removal by predicate", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+    v.enableIndex();
+    REQUIRE( v.indexOf(9) == 9 );
+    REQUIRE( v.removeIf([](const int &i) { return i == 2 || i == 8; }) == 2 );
+    REQUIRE( v.indexOf(3) == 2 );
+    REQUIRE( v.indexOf(7) == 6 );
+    REQUIRE( v.indexOf(9) == 7 );
+}
+
+TEST_CASE( "Memory usage and shrinking", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    REQUIRE( v.memoryUsage().total() == 0 );
+
+    for(int i = 0; i < 1000; i++)
+        v.push_back(i);
+    for(int i = 0; i < 100; i++)
+        v.pop_front();
+
+    PtrListMemoryUsage u = v.memoryUsage();
+    REQUIRE( u.elements == 900 * sizeof(int) );
+    REQUIRE( u.pointerArray >= v.capacity() * sizeof(VPtrList<int>::SHptr) );
+    REQUIRE( u.slack >= 100 * sizeof(VPtrList<int>::SHptr) );
+    REQUIRE( u.overhead > 0 );
+
+    v.shrink_to_fit();
+    u = v.memoryUsage();
+    REQUIRE( u.slack == 0 );
+    REQUIRE( v[899] == 999 );
+}
+
+TEST_CASE( "Lookups by element address", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    for(int i = 0; i < 20; i++)
+        v.push_back(i % 5);
+
+    SECTION( "Without index" ) {
+    }
+
+    SECTION( "Address index" ) {
+        v.enableAddressIndex();
+        REQUIRE( v.isAddressIndexed() );
+    }
+
+    SECTION( "Hash index" ) {
+        v.enableIndex();
+    }
+
+    // Duplicates are told apart by the address
+    int *dup = &v[12];
+    REQUIRE( v.indexOf(2) == 2 );
+    REQUIRE( v.indexOfPtr(dup) == 12 );
+    REQUIRE( &*v.iteratorFor(dup) == dup );
+
+    int outside = 2;
+    REQUIRE( v.indexOfPtr(&outside) == -1 );
+    REQUIRE( v.iteratorFor(&outside) == v.end() );
+    REQUIRE( !v.removeByPtr(&outside) );
+
+    v.insert(3, 100);
+    v.push_front(-1);
+    REQUIRE( v.indexOfPtr(dup) == 14 );
+    v.swap(0, 14);
+    REQUIRE( v.indexOfPtr(dup) == 0 );
+    v.move(0, 10);
+    REQUIRE( v.indexOfPtr(dup) == 10 );
+    v.stable_sort();
+    REQUIRE( v[size_t(v.indexOfPtr(dup))] == 2 );
+    REQUIRE( &v[size_t(v.indexOfPtr(dup))] == dup );
+
+    int *last = &v.back();
+    REQUIRE( v.removeByPtr(dup) );
+    REQUIRE( v.indexOfPtr(dup) == -1 );
+    REQUIRE( v.size() == 21 );
+    REQUIRE( v.indexOfPtr(last) == 20 );
+    size_t twos = 0;
+    for(int i : v)
+        twos += (i == 2);
+    REQUIRE( twos == 3 );
+
+    v.removeAt(0, 5);
+    REQUIRE( v.indexOfPtr(last) == 15 );
+    v.clear();
+    REQUIRE( v.indexOfPtr(last) == -1 );
+}
+
+TEST_CASE( "Address index follows mixed operations", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    v.enableAddressIndex();
+    for(int i = 0; i < 300; i++)
+        v.push_back(i);
+
+    unsigned seed = 12345;
+    for(int step = 0; step < 3000; step++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        size_t at = v.size() == 0 ? 0 : (seed >> 8) % v.size();
+        switch(step % 9)
+        {
+        case 0: v.insert(at, step); break;
+        case 1: if(!v.size() == 0) v.removeAt(at); break;
+        case 2: v.push_front(step); break;
+        case 3: if(!v.size() == 0) v.pop_front(); break;
+        case 4: v.push_back(step); break;
+        case 5: if(!v.size() == 0) v.swap(at, v.size() - 1); break;
+        case 6: if(!v.size() == 0) REQUIRE( v.removeByPtr(&v[at]) ); break;
+        case 7: if(!v.size() == 0) v.pop_back(); break;
+        case 8:
+            if(step % 90 == 8)
+                v.move(0, v.size() / 2);
+            else if(step % 90 == 17)
+                v.resize(v.size() - v.size() / 8);
+            else
+                v.insert(at, {step, step + 1});
+            break;
+        }
+
+        // Every element is found at it's slot
+        for(size_t i = 0; i < v.size(); i += (step % 100 == 0) ? 1 : 17)
+            REQUIRE( v.indexOfPtr(&v[i]) == ssize_t(i) );
+    }
+}
+
+TEST_CASE( "Unordered removal", "[VPtrList]" )
+{
+    VPtrList<int> v;
+    for(int i = 0; i < 10; i++)
+        v.push_back(i);
+
+    SECTION( "By position" ) {
+        int *last = &v[9];
+        v.removeAtUnordered(2);
+        REQUIRE( v.size() == 9 );
+        REQUIRE( &v[2] == last );
+        REQUIRE( v[8] == 8 );
+        v.removeAtUnordered(8);
+        REQUIRE( v.size() == 8 );
+        REQUIRE( v.back() == 7 );
+    }
+
+    SECTION( "By value" ) {
+        v.enableIndex();
+        REQUIRE( v.removeOneUnordered(0) );
+        REQUIRE( !v.removeOneUnordered(0) );
+        REQUIRE( v[0] == 9 );
+        REQUIRE( v.indexOf(9) == 0 );
+        REQUIRE( v.indexOf(8) == 8 );
+    }
+
+    SECTION( "By predicate" ) {
+        // Elements moved into the hole are checked too
+        REQUIRE( v.removeIfUnordered([](const int &i) { return i == 1 || i >= 7; }) == 4 );
+        REQUIRE( v.size() == 6 );
+        int sum = 0;
+        for(int i : v)
+            sum += i;
+        REQUIRE( sum == 0 + 2 + 3 + 4 + 5 + 6 );
+        REQUIRE( v[1] == 6 );
+        REQUIRE( v.removeIfUnordered([](const int &) { return true; }) == 6 );
+        REQUIRE( v.size() == 0 );
+    }
+}
+
+template<class List>
+static List makeRangeList()
+{
+    List l;
+    for(int i = 0; i < 5; i++)
+        l.push_back(i);
+    return l;
+}
+
+TEST_CASE( "Range insertions", "[VPtrList]" )
+{
+    VPtrList<int> v = makeRangeList<VPtrList<int> >();
+    std::vector<int> src = {100, 101, 102};
+
+    SECTION( "Iterators" ) {
+        v.insert(1, src.begin(), src.end());
+        REQUIRE( v.size() == 8 );
+        REQUIRE( v[0] == 0 );
+        REQUIRE( v[1] == 100 );
+        REQUIRE( v[3] == 102 );
+        REQUIRE( v[4] == 1 );
+        v.append(src.begin(), src.begin() + 2);
+        REQUIRE( v.size() == 10 );
+        REQUIRE( v[9] == 101 );
+        v.insert(9, src.end(), src.end());
+        REQUIRE( v.size() == 10 );
+    }
+
+    SECTION( "Initializer lists" ) {
+        v.insert(4, {7, 8});
+        v.append({9});
+        v.insert(0, {-2, -1});
+        REQUIRE( v.size() == 10 );
+        int expected[] = {-2, -1, 0, 1, 2, 3, 7, 8, 4, 9};
+        bool same = true;
+        for(size_t i = 0; i < 10; i++)
+            same = same && v[i] == expected[i];
+        REQUIRE( same );
+    }
+
+    SECTION( "Other list" ) {
+        VPtrList<int> o = makeRangeList<VPtrList<int> >();
+        int *first = &v[0];
+        v.insert(2, o);
+        REQUIRE( v.size() == 10 );
+        REQUIRE( o.size() == 5 );
+        REQUIRE( &v[0] == first );
+        REQUIRE( v[2] == 0 );
+        REQUIRE( v[6] == 4 );
+        REQUIRE( v[7] == 2 );
+
+        const VPtrList<int> &c = o;
+        v.append(c);
+        REQUIRE( v.size() == 15 );
+        REQUIRE( v[14] == 4 );
+
+        v.append(v);
+        REQUIRE( v.size() == 30 );
+        REQUIRE( v[15] == 0 );
+        REQUIRE( v[29] == 4 );
+
+        const int *o4 = &o[4];
+        v.insert(0, std::move(o));
+        REQUIRE( o.size() == 0 );
+        REQUIRE( v.size() == 35 );
+        REQUIRE( v[4] == 4 );
+        REQUIRE( &v[4] == o4 );
+        REQUIRE( v[5] == 0 );
+        o.push_back(1);
+        REQUIRE( o.size() == 1 );
+    }
+
+    SECTION( "Index is kept" ) {
+        v.enableIndex();
+        v.insert(2, src.begin(), src.end());
+        REQUIRE( v.indexOf(101) == 3 );
+        REQUIRE( v.indexOf(4) == 7 );
+        REQUIRE( v.contains(102) );
+    }
+}
+
+TEST_CASE( "Copy-on-write sharing", "[VPtrList]" )
+{
+    VPtrList<int> src;
+    for(int i = 0; i < 10; i++)
+        src.push_back(i);
+
+    PtrListCow<VPtrList<int> > a(std::move(src));
+    PtrListCow<VPtrList<int> > b(a);
+    PtrListCow<VPtrList<int> > c;
+    c = b;
+    REQUIRE( a.useCount() == 3 );
+    REQUIRE( &a.read() == &c.read() );
+    REQUIRE( &a.read()[5] == &b.read()[5] );
+
+    // Only the written holder gets a copy
+    const int *shared5 = &a.read()[5];
+    b.edit().push_back(10);
+    REQUIRE( b.size() == 11 );
+    REQUIRE( a.size() == 10 );
+    REQUIRE( !b.isShared() );
+    REQUIRE( a.useCount() == 2 );
+    REQUIRE( &b.read()[5] != shared5 );
+    REQUIRE( &a.read()[5] == shared5 );
+
+    // Not shared list is edited in place
+    int *own = &b.edit()[0];
+    b.edit()[0] = 100;
+    REQUIRE( &b.read()[0] == own );
+    REQUIRE( b.read()[0] == 100 );
+    REQUIRE( c.read()[0] == 0 );
+
+    int sum = 0;
+    for(const int &i : *c)
+        sum += i;
+    REQUIRE( sum == 45 );
+    REQUIRE( c->size() == 10 );
+
+    PtrListCow<VPtrList<int> > moved(std::move(c));
+    REQUIRE( c.size() == 0 );
+    REQUIRE( moved.size() == 10 );
+    REQUIRE( a.useCount() == 2 );
+}
+
+// Copying of the element with value -1 fails
+struct CloneItem
+{
+    int v;
+    CloneItem(int i) : v(i) {}
+    CloneItem(const CloneItem &o) : v(o.v)
+    {
+        if(v == -1)
+            throw std::runtime_error("copy failed");
+    }
+};
+
+template<>
+struct PtrListThreadSafeCopy<CloneItem> : std::true_type {};
+
+template<>
+struct PtrListThreadSafeCopy<std::string> : std::true_type {};
+
+TEST_CASE( "Parallel clone", "[VPtrList]" )
+{
+    VPtrList<std::string> v;
+    for(int i = 0; i < 1000; i++)
+        v.push_back(std::to_string(i));
+
+    SECTION( "Elements are copied" ) {
+        VPtrList<std::string> c = v.clone(4, 1);
+        REQUIRE( c.size() == 1000 );
+        for(size_t i = 0; i < c.size(); i++)
+        {
+            REQUIRE( c[i] == v[i] );
+            REQUIRE( &c[i] != &v[i] );
+        }
+        c.push_back("end");
+        REQUIRE( c.back() == "end" );
+    }
+
+    SECTION( "Small lists are copied sequentially" ) {
+        VPtrList<std::string> c = v.clone(4);
+        REQUIRE( c.size() == 1000 );
+        REQUIRE( c[999] == "999" );
+    }
+
+    SECTION( "Headroom is not copied" ) {
+        for(int i = 0; i < 10; i++)
+            v.pop_front();
+        VPtrList<std::string> c = v.clone(3, 1);
+        REQUIRE( c.size() == 990 );
+        REQUIRE( c.front() == "10" );
+    }
+
+    SECTION( "Indices are rebuilt" ) {
+        v.enableIndex();
+        v.enableAddressIndex();
+        VPtrList<std::string> c = v.clone(4, 1);
+        REQUIRE( c.contains("500") );
+        REQUIRE( c.indexOf("500") == 500 );
+        REQUIRE( c.indexOfPtr(&c[700]) == 700 );
+        REQUIRE( c.indexOfPtr(&v[700]) == -1 );
+    }
+
+    SECTION( "Result is moved" ) {
+        v.enableIndex();
+        const std::string *first = &v[0];
+        VPtrList<std::string> m(std::move(v));
+        REQUIRE( v.size() == 0 );
+        REQUIRE( &m[0] == first );
+        REQUIRE( m.contains("10") );
+        v = std::move(m);
+        REQUIRE( m.size() == 0 );
+        REQUIRE( &v[0] == first );
+        v.push_back("x");
+        m.push_back("y");
+        REQUIRE( v.size() == 1001 );
+        REQUIRE( m.size() == 1 );
+    }
+
+    SECTION( "Custom allocator" ) {
+        g_countingAllocated = 0;
+        VPtrList<int, CountingAllocator<int> > a;
+        for(int i = 0; i < 100; i++)
+            a.push_back(i);
+        VPtrList<int, CountingAllocator<int> > c = a.clone(4, 1);
+        REQUIRE( c.size() == 100 );
+        REQUIRE( c[99] == 99 );
+        REQUIRE( g_countingAllocated == 200 );
+    }
+
+    SECTION( "Failed copy" ) {
+        VPtrList<CloneItem> f;
+        for(int i = 0; i < 1000; i++)
+            f.push_back(CloneItem(i));
+        f[700].v = -1;
+        REQUIRE_THROWS_AS( f.clone(4, 1), std::runtime_error );
+        REQUIRE( f.size() == 1000 );
+    }
+}
+
+TEST_CASE( "Ownership transfer", "[VPtrList]" )
+{
+    VPtrList<std::string> a, b;
+    for(int i = 0; i < 10; i++)
+        a.push_back(std::to_string(i));
+    for(int i = 0; i < 5; i++)
+        b.push_back("b" + std::to_string(i));
+    const std::string *a3 = &a[3], *a4 = &a[4], *a5 = &a[5];
+
+    SECTION( "Splicing between lists" ) {
+        a.enableIndex();
+        b.enableIndex();
+        b.splice(1, a, 3, 6);
+        REQUIRE( a.size() == 7 );
+        REQUIRE( b.size() == 8 );
+        REQUIRE( a[3] == "6" );
+        REQUIRE( &b[1] == a3 );
+        REQUIRE( &b[2] == a4 );
+        REQUIRE( &b[3] == a5 );
+        REQUIRE( b[0] == "b0" );
+        REQUIRE( b[4] == "b1" );
+        REQUIRE( !a.contains("4") );
+        REQUIRE( b.contains("4") );
+        REQUIRE( b.indexOf("5") == 3 );
+        REQUIRE( b.indexOf("b4") == 7 );
+
+        b.splice(b.size(), a);
+        REQUIRE( a.size() == 0 );
+        REQUIRE( b.size() == 15 );
+        REQUIRE( b.back() == "9" );
+        a.push_back("new");
+        REQUIRE( a[0] == "new" );
+    }
+
+    SECTION( "Splicing inside of the list" ) {
+        a.splice(0, a, 3, 6);
+        REQUIRE( &a[0] == a3 );
+        REQUIRE( &a[2] == a5 );
+        REQUIRE( a[3] == "0" );
+        REQUIRE( a[6] == "6" );
+        a.splice(a.size(), a, 0, 3);
+        REQUIRE( &a[9] == a5 );
+        REQUIRE( a[0] == "0" );
+        REQUIRE( a[6] == "9" );
+        a.splice(1, a, 0, 3);
+        REQUIRE( a[0] == "0" );
+        REQUIRE( a.size() == 10 );
+    }
+
+    SECTION( "Taking and adopting" ) {
+        a.enableAddressIndex();
+        REQUIRE( a.indexOfPtr(a5) == 5 );
+        std::unique_ptr<std::string> taken(a.takeAt(3));
+        REQUIRE( taken.get() == a3 );
+        REQUIRE( a.size() == 9 );
+        REQUIRE( a.indexOfPtr(a3) == -1 );
+        REQUIRE( a.indexOfPtr(a5) == 4 );
+
+        std::string *released = a.release(3);
+        REQUIRE( released == a4 );
+        REQUIRE( a[3] == "5" );
+
+        b.adopt(released);
+        b.adopt(0, taken.release());
+        REQUIRE( b.size() == 7 );
+        REQUIRE( &b[0] == a3 );
+        REQUIRE( &b.back() == a4 );
+        b.adopt(std::unique_ptr<std::string>(new std::string("own")));
+        REQUIRE( b.back() == "own" );
+    }
+}
+
+TEST_CASE( "Storage adoption and conversions", "[VPtrList]" )
+{
+    std::vector<std::unique_ptr<std::string> > items;
+    for(int i = 0; i < 10; i++)
+        items.emplace_back(new std::string(std::to_string(i)));
+    const std::string *s5 = items[5].get();
+
+    VPtrList<std::string> v(std::move(items));
+    REQUIRE( v.size() == 10 );
+    REQUIRE( &v[5] == s5 );
+    v.pop_front();
+    v.enableIndex();
+
+    items = v.takeStorage();
+    REQUIRE( items.size() == 9 );
+    REQUIRE( items[4].get() == s5 );
+    REQUIRE( v.size() == 0 );
+    REQUIRE( !v.contains("5") );
+    v.push_back("new");
+    REQUIRE( v[0] == "new" );
+
+    SECTION( "To PtrList" ) {
+        VPtrList<std::string> src(std::move(items));
+        PtrList<std::string> p = toPtrList(std::move(src));
+        REQUIRE( src.size() == 0 );
+        REQUIRE( p.size() == 9 );
+        REQUIRE( &p[4] == s5 );
+        p.push_back("10");
+        REQUIRE( p.back() == "10" );
+
+        SECTION( "And back" ) {
+            p.pop_front();
+            VPtrList<std::string> back = toVPtrList(std::move(p));
+            REQUIRE( p.size() == 0 );
+            REQUIRE( back.size() == 9 );
+            REQUIRE( &back[3] == s5 );
+            REQUIRE( back.front() == "2" );
+            REQUIRE( back.back() == "10" );
+        }
+    }
+}
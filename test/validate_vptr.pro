@@ -1,5 +1,5 @@
 TEMPLATE = app
-CONFIG += console c++11
+CONFIG += console c++11 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
@@ -17,4 +17,10 @@ SOURCES += \
     validate_vptr.cpp
 
 HEADERS += \
-    ../vptrlist.h
+    ../vptrlist.h \
+    ../ptrlist_index.h \
+    ../ptrlist_sort.h \
+    ../ptrlist_stats.h \
+    ../ptrlist_cow.h \
+    ../ptrlist.h \
+    ../ptrlist_convert.h
@@ -28,9 +28,19 @@ DEALINGS IN THE SOFTWARE.
 
 #include <vector>
 #include <memory>
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 #include <assert.h>
 #include <stddef.h>
 
+#include "ptrlist_index.h"
+#include "ptrlist_sort.h"
+#include "ptrlist_stats.h"
+
 #if defined(__EMSCRIPTEN__) || !defined(_WIN32)
 #include <sys/types.h>
 #endif
@@ -43,19 +53,160 @@ typedef int ssize_t;
 #endif
 #endif
 
+/*
+ * Deleter which returns element back into the allocator it was taken from.
+ * Stateless allocators are kept as an empty base, so a slot of the list
+ * stays as big as a plain pointer.
+ */
+template<typename _Alloc, bool stateless = std::is_empty<_Alloc>::value>
+struct VPtrListDeleter
+{
+    typedef std::allocator_traits<_Alloc>   traits;
+    typedef typename traits::value_type     value_type;
+
+    _Alloc alloc;
+
+    VPtrListDeleter() : alloc() {}
+    VPtrListDeleter(const _Alloc &a) : alloc(a) {}
+
+    void operator()(value_type *p)
+    {
+        traits::destroy(alloc, p);
+        traits::deallocate(alloc, p, 1);
+    }
+};
+
+template<typename _Alloc>
+struct VPtrListDeleter<_Alloc, true> : private _Alloc
+{
+    typedef std::allocator_traits<_Alloc>   traits;
+    typedef typename traits::value_type     value_type;
+
+    VPtrListDeleter() : _Alloc() {}
+    VPtrListDeleter(const _Alloc &a) : _Alloc(a) {}
+
+    void operator()(value_type *p)
+    {
+        _Alloc &alloc = *this;
+        traits::destroy(alloc, p);
+        traits::deallocate(alloc, p, 1);
+    }
+};
+
+/*
+ * Creates and deletes elements through the allocator.
+ * The std::allocator case is kept on top of new/delete and std::default_delete
+ * (which is equivalent), so the storage stays a regular std::vector<std::unique_ptr<T>>.
+ */
+template<class T, typename _Alloc>
+struct VPtrListElements
+{
+    typedef std::allocator_traits<_Alloc>   traits;
+    typedef VPtrListDeleter<_Alloc>         deleter_type;
+
+    // The allocator may be not thread-safe, so clone() copies on one thread
+    static const bool concurrent = false;
+
+    template<typename... _Args>
+    static T *create(_Alloc &a, _Args&&... __args)
+    {
+        T *p = traits::allocate(a, 1);
+        try
+        {
+            traits::construct(a, p, std::forward<_Args>(__args)...);
+        }
+        catch(...)
+        {
+            traits::deallocate(a, p, 1);
+            throw;
+        }
+        return p;
+    }
+
+    static deleter_type deleter(const _Alloc &a)
+    {
+        return deleter_type(a);
+    }
+};
+
+template<class T>
+struct VPtrListElements<T, std::allocator<T>>
+{
+    typedef std::default_delete<T>          deleter_type;
+
+    // new is thread-safe
+    static const bool concurrent = true;
+
+    template<typename... _Args>
+    static T *create(std::allocator<T> &, _Args&&... __args)
+    {
+        return new T(std::forward<_Args>(__args)...);
+    }
+
+    static deleter_type deleter(const std::allocator<T> &)
+    {
+        return deleter_type();
+    }
+};
+
+/*
+ * Keeps the element allocator. Stateless allocators are not stored at all
+ * to don't grow the list itself.
+ */
+template<typename _Alloc, bool stateless = std::is_empty<_Alloc>::value>
+class VPtrListAllocHolder
+{
+    _Alloc m_alloc;
+public:
+    VPtrListAllocHolder(const _Alloc &a) : m_alloc(a) {}
+    _Alloc &elementAllocator() { return m_alloc; }
+    const _Alloc &elementAllocator() const { return m_alloc; }
+};
+
+template<typename _Alloc>
+class VPtrListAllocHolder<_Alloc, true>
+{
+public:
+    VPtrListAllocHolder(const _Alloc &) {}
+    _Alloc elementAllocator() const { return _Alloc(); }
+};
+
+/*
+ * Only elements are allocated by the _Alloc, the array of pointers itself is
+ * a regular std::vector, so it's reallocations don't consume the element pool
+ */
+template<class T, typename _Alloc>
+struct VPtrListStorage
+{
+    typedef VPtrListElements<T, _Alloc>                     elements;
+    typedef std::unique_ptr<T, typename elements::deleter_type> SHptr;
+    typedef std::vector<SHptr>                              vecPTR;
+    typedef VPtrListAllocHolder<_Alloc>                     allocHolder;
+};
+
 template<class T, typename _Alloc = std::allocator<T>>
-class VPtrList : private std::vector<std::unique_ptr<T>>
+class VPtrList : private VPtrListStorage<T, _Alloc>::vecPTR,
+                 private VPtrListStorage<T, _Alloc>::allocHolder,
+                 public PtrListCounters
 {
+    typedef VPtrListStorage<T, _Alloc>      Storage;
+    typedef typename Storage::elements      Elements;
+    typedef typename Storage::allocHolder   AllocHolder;
+
+    // Count of empty slots before the first element, allows O(1) push_front/pop_front
+    size_t m_head;
+    std::unique_ptr<PtrListIndex<T>> m_index;
+    std::unique_ptr<PtrListPositions<T>> m_positions;
 public:
-    typedef std::unique_ptr<T> SHptr;
-    typedef std::vector<SHptr>              vecPTR;
+    typedef typename Storage::SHptr         SHptr;
+    typedef typename Storage::vecPTR        vecPTR;
     typedef typename vecPTR::iterator       S_iterator;
     typedef typename vecPTR::const_iterator S_const_iterator;
     typedef typename vecPTR::reverse_iterator       SR_iterator;
     typedef typename vecPTR::const_reverse_iterator SR_const_iterator;
 
     typedef T                               value_type;
-    typedef typename vecPTR::allocator_type allocator_type;
+    typedef _Alloc                          allocator_type;
     typedef size_t                          size_type;
     typedef std::ptrdiff_t                  difference_type;
     typedef T&                              reference;
@@ -73,15 +224,20 @@ public:
 #endif
         SIterator p;
     public:
-        VPtrIterator(const VPtrIterator&o) : p(o.p) {}
+        typedef std::forward_iterator_tag               iterator_category;
+        typedef typename std::remove_const<TT>::type    value_type;
+        typedef std::ptrdiff_t                          difference_type;
+        typedef TT*                                     pointer;
+        typedef TT&                                     reference;
+
         VPtrIterator(const SIterator &o) : p(o) {}
         virtual ~VPtrIterator() {}
 
-        TT &operator*()
+        TT &operator*() const
         {
             return *(p.operator*());
         }
-        TT *operator->()
+        TT *operator->() const
         {
             return (p.operator*().get());
         }
@@ -170,9 +326,36 @@ public:
     typedef VPtrIterator<T, SR_iterator>                reverse_iterator;
     typedef VPtrIterator<const T, SR_const_iterator>    const_reverse_iterator;
 
+private:
+    S_iterator sbegin()
+    {
+        return vecPTR::begin() + m_head;
+    }
+    S_const_iterator sbegin() const
+    {
+        return vecPTR::cbegin() + m_head;
+    }
+    SHptr *sdata()
+    {
+        return vecPTR::data() + m_head;
+    }
+    const SHptr *sdata() const
+    {
+        return vecPTR::data() + m_head;
+    }
+
+    // Slots of the headroom are out of range too, negative indices become too big by the cast
+    T &checkedAt(size_t index) const
+    {
+        if(index >= size())
+            throw std::out_of_range("VPtrList: index is out of range");
+        return *sdata()[index];
+    }
+
+public:
     iterator begin()
     {
-        return vecPTR::begin();
+        return sbegin();
     }
     iterator end()
     {
@@ -180,7 +363,7 @@ public:
     }
     const_iterator begin() const
     {
-        return vecPTR::begin();
+        return sbegin();
     }
     const_iterator end() const
     {
@@ -189,7 +372,7 @@ public:
 
     const_iterator cbegin() const
     {
-        return vecPTR::cbegin();
+        return sbegin();
     }
     const_iterator cend() const
     {
@@ -198,11 +381,11 @@ public:
 
     reverse_iterator rbegin()
     {
-        return vecPTR::begin();
+        return vecPTR::rbegin();
     }
     reverse_iterator rend()
     {
-        return vecPTR::rend();
+        return SR_iterator(sbegin());
     }
     const_reverse_iterator rbegin() const
     {
@@ -210,7 +393,7 @@ public:
     }
     const_reverse_iterator rend() const
     {
-        return vecPTR::rend();
+        return SR_const_iterator(sbegin());
     }
 
     const_reverse_iterator crbegin() const
@@ -219,82 +402,455 @@ public:
     }
     const_reverse_iterator crend() const
     {
-        return vecPTR::crend();
+        return SR_const_iterator(sbegin());
     }
 
 
-    VPtrList() : vecPTR()
+    VPtrList() : vecPTR(), AllocHolder(allocator_type()), m_head(0), m_index(), m_positions()
     {}
 
-    VPtrList(const VPtrList<T>& o) : vecPTR()
-    {
-        if (this != &o)
+    explicit VPtrList(const allocator_type &a) : vecPTR(), AllocHolder(a), m_head(0), m_index(), m_positions()
+    {}
+
+    VPtrList(const VPtrList& o) :
+        vecPTR(),
+        AllocHolder(std::allocator_traits<allocator_type>::select_on_container_copy_construction(o.get_allocator())),
+        PtrListCounters(),
+        m_head(0),
+        m_index(o.m_index ? new PtrListIndex<T>(*o.m_index) : nullptr),
+        m_positions(o.m_positions ? new PtrListPositions<T>() : nullptr)
+    {
+        this->append(o);
+    }
+
+    /*
+     * Deep copy like the copy constructor, but elements are copied by `threads`
+     * threads at once (threads = 0 uses all hardware threads). Lists with less
+     * than `threshold` elements per thread, lists of types which aren't marked
+     * as PtrListThreadSafeCopy and lists with custom allocators are copied on
+     * the calling thread.
+     */
+    VPtrList clone(unsigned threads = 0, size_t threshold = PtrListParallel::defaultCopyThreshold) const
+    {
+        size_t num = size();
+        if (!PtrListThreadSafeCopy<T>::value || !Elements::concurrent)
+            threads = 1;
+        threads = PtrListParallel::threadsFor(num, threads, threshold);
+
+        VPtrList ret(std::allocator_traits<allocator_type>::select_on_container_copy_construction(get_allocator()));
+        if (m_index)
+            ret.m_index.reset(new PtrListIndex<T>(*m_index));
+        if (m_positions)
+            ret.m_positions.reset(new PtrListPositions<T>());
+
+        if (threads < 2)
         {
-            vecPTR::clear();
-            this->append(o);
+            ret.append(*this);
+            return ret;
+        }
+
+        vecPTR &items = ret;
+        items.resize(num);
+        SHptr *out = items.data();
+        const SHptr *src = sdata();
+        allocator_type alloc(ret.get_allocator());
+        try
+        {
+            PtrListParallel::forChunks(num, threads, [out, src, &alloc](size_t b, size_t e)
+            {
+                allocator_type a(alloc);
+                for (size_t i = b; i < e; i++)
+                    out[i] = SHptr(Elements::create(a, *src[i]), Elements::deleter(a));
+            });
+        }
+        catch (...)
+        {
+            items.clear();
+            throw;
         }
+        ret.countAllocations(num);
+        ret.reindex();
+        return ret;
+    }
+
+    // Takes the pointer array, elements and indices of other list, which becomes empty
+    VPtrList(VPtrList &&o) :
+        vecPTR(std::move(static_cast<vecPTR&>(o))),
+        AllocHolder(o.get_allocator()),
+        m_head(o.m_head),
+        m_index(std::move(o.m_index)),
+        m_positions(std::move(o.m_positions))
+    {
+        static_cast<vecPTR&>(o).clear();
+        o.m_head = 0;
+    }
+
+    // Takes the vector of elements in O(1), it must not contain null pointers
+    explicit VPtrList(vecPTR &&items, const allocator_type &a = allocator_type()) :
+        vecPTR(std::move(items)), AllocHolder(a), m_head(0), m_index(), m_positions()
+    {
+        assert(std::find(vecPTR::begin(), vecPTR::end(), nullptr) == vecPTR::end());
     }
 
-    VPtrList(std::initializer_list<T> il) : vecPTR()
+    VPtrList(std::initializer_list<T> il, const allocator_type &a = allocator_type()) :
+        vecPTR(), AllocHolder(a), m_head(0), m_index(), m_positions()
     {
         this->assign(il);
     }
 
-    VPtrList(size_t size) : vecPTR(size)
-    {}
+    VPtrList(size_t size, const allocator_type &a = allocator_type()) :
+        vecPTR(), AllocHolder(a), m_head(0), m_index(), m_positions()
+    {
+        this->resize(size);
+    }
+
 
+    ~VPtrList()
+    {
+        countFrees(size());
+    }
 
     VPtrList &operator=(const VPtrList &o)
     {
         if (this != &o)
         {
-            vecPTR::clear();
+            this->clear();
             this->append(o);
         }
         return *this;
     }
 
+    VPtrList &operator=(VPtrList &&o)
+    {
+        if (this != &o)
+        {
+            this->clear();
+            vecPTR::operator=(std::move(static_cast<vecPTR&>(o)));
+            AllocHolder::operator=(o);
+            m_head = o.m_head;
+            m_index = std::move(o.m_index);
+            m_positions = std::move(o.m_positions);
+            static_cast<vecPTR&>(o).clear();
+            o.m_head = 0;
+        }
+        return *this;
+    }
+
+private:
+    template<typename... _Args>
+    SHptr makeItem(_Args&&... __args)
+    {
+        allocator_type a(AllocHolder::elementAllocator());
+        T *p = Elements::create(a, std::forward<_Args>(__args)...);
+        SHptr item(p, Elements::deleter(a));
+        countAllocations(1);
+        return item;
+    }
+
+    // Stores already created element at the end, the back must be prepared
+    void pushItem(SHptr &&item)
+    {
+        size_t cap = vecPTR::capacity();
+        vecPTR::push_back(std::move(item));
+        countGrowth(cap, vecPTR::size() - 1);
+        indexStored(size() - 1, &item, 1);
+    }
+
+    // Counts the reallocation of the pointer array if it has happened
+    void countGrowth(size_t oldCapacity, size_t copied)
+    {
+        if (vecPTR::capacity() != oldCapacity)
+            countReallocation(sizeof(SHptr) * copied);
+    }
+
+    /*
+     * Elements are indexed only after they have been stored at slots [at, at + num),
+     * so a failed store leaves no trace in the index. If the indexing fails, they
+     * are taken back out to the items array.
+     */
+    void indexStored(size_t at, SHptr *items, size_t num)
+    {
+        if (!m_index)
+            return;
+        SHptr *d = sdata() + at;
+        size_t done = 0;
+        try
+        {
+            for (; done < num; done++)
+                m_index->added(d[done].get());
+        }
+        catch(...)
+        {
+            unindex(d, d + done);
+            std::move(d, d + num, items);
+            dropSlots(at, num);
+            throw;
+        }
+    }
+
+    void unindex(const SHptr *first, const SHptr *last)
+    {
+        if (m_index)
+        {
+            for (const SHptr *i = first; i != last; i++)
+                m_index->removed(i->get());
+        }
+        if (m_positions)
+        {
+            for (const SHptr *i = first; i != last; i++)
+                m_positions->removed(i->get());
+        }
+    }
+
+    // Elements at this slot and after it were reordered
+    void shifted(size_t from)
+    {
+        if (m_index)
+            m_index->shifted(from);
+        if (m_positions)
+            m_positions->shifted(from);
+    }
+
+    // Slots were inserted or removed, elements after them were moved by num
+    void inserted(size_t at, size_t num)
+    {
+        if (m_index)
+            m_index->inserted(at, num);
+        if (m_positions)
+            m_positions->inserted(at, num);
+    }
+
+    void erased(size_t at, size_t num)
+    {
+        if (m_index)
+            m_index->erased(at, num);
+        if (m_positions)
+            m_positions->erased(at, num);
+    }
+
+    void setIndex(PtrListIndex<T> *index)
+    {
+        m_index.reset(index);
+        reindex();
+    }
+
+    // Drops the empty front slots instead of reallocating when the back is full,
+    // so a queue (push_back + pop_front) doesn't grow forever
+    void prepareBack(size_t n = 1)
+    {
+        if (m_head > 0 && m_head >= size() && vecPTR::size() + n > vecPTR::capacity())
+        {
+            vecPTR::erase(vecPTR::begin(), sbegin());
+            countShifts(vecPTR::size());
+            m_head = 0;
+        }
+    }
+
+    // Makes a headroom before the first element proportional to the size
+    void growFront()
+    {
+        size_t s = size();
+        size_t room = s > 8 ? s : 8;
+        vecPTR tmp;
+        tmp.reserve(room + s + (vecPTR::capacity() - vecPTR::size()));
+        tmp.resize(room);
+        for (S_iterator i = sbegin(); i != vecPTR::end(); i++)
+            tmp.push_back(std::move(*i));
+        vecPTR::swap(tmp);
+        countReallocation(sizeof(SHptr) * s);
+        m_head = room;
+    }
+
+    iterator insertItem(size_t at, SHptr &&item)
+    {
+        size_t s = size();
+        assert(at <= s);
+        if (at < (s + 1) / 2)
+        {
+            // Shift the front part into the headroom
+            if (m_head == 0)
+                growFront();
+            SHptr *d = sdata();
+            std::move(d, d + at, d - 1);
+            countShifts(at);
+            m_head--;
+            sdata()[at] = std::move(item);
+            inserted(at, 1);
+            indexStored(at, &item, 1);
+            return iterator(sbegin() + at);
+        }
+        prepareBack();
+        countShifts(s - at);
+        size_t cap = vecPTR::capacity();
+        vecPTR::insert(sbegin() + at, std::move(item));
+        countGrowth(cap, vecPTR::size() - 1);
+        inserted(at, 1);
+        indexStored(at, &item, 1);
+        return iterator(sbegin() + at);
+    }
+
+    // Creates num elements from the sequence, then puts them at the given position by one shift
+    template<class InputIt>
+    void insertRange(size_t at, size_t num, InputIt first)
+    {
+        assert(at <= size());
+        if (num == 0)
+            return;
+        vecPTR items;
+        items.reserve(num);
+        try
+        {
+            for (size_t i = 0; i < num; ++i, ++first)
+                items.push_back(makeItem(*first));
+        }
+        catch(...)
+        {
+            countFrees(items.size());
+            throw;
+        }
+
+        placeItems(at, items.data(), num);
+    }
+
+    // Rotates [first, last) into the position dst, positions are given before the move
+    void spliceSelf(size_t dst, size_t first, size_t last)
+    {
+        SHptr *d = sdata();
+        if (dst < first)
+        {
+            std::rotate(d + dst, d + first, d + last);
+            countShifts(last - dst);
+            shifted(dst);
+        }
+        else if (dst > last)
+        {
+            std::rotate(d + first, d + last, d + dst);
+            countShifts(dst - first);
+            shifted(first);
+        }
+    }
+
+    // Moves num already created elements to the given position by one shift
+    void placeItems(size_t at, SHptr *items, size_t num)
+    {
+        size_t s = size();
+        if (at < s - at && m_head >= num)
+        {
+            // Front part is shorter: shift it into the headroom
+            SHptr *d = sdata();
+            std::move(d, d + at, d - num);
+            countShifts(at);
+            m_head -= num;
+            std::move(items, items + num, sdata() + at);
+        }
+        else
+        {
+            prepareBack(num);
+            countShifts(s - at);
+            size_t cap = vecPTR::capacity();
+            vecPTR::insert(sbegin() + at, std::make_move_iterator(items), std::make_move_iterator(items + num));
+            countGrowth(cap, vecPTR::size() - num);
+        }
+        inserted(at, num);
+        indexStored(at, items, num);
+    }
+
+    // Erases empty slots left at the end by the removal which has compacted the list
+    size_t dropRemovedTail(size_t s, size_t moveTo, size_t firstRemoved)
+    {
+        size_t removed = s - moveTo;
+        if (removed > 0)
+        {
+            shifted(firstRemoved);
+            countFrees(removed);
+            countShifts(moveTo - firstRemoved);
+            vecPTR::erase(vecPTR::end() - removed, vecPTR::end());
+            if (vecPTR::size() == m_head)
+                clear();
+        }
+        return removed;
+    }
+
+    iterator removeItems(size_t at, size_t num)
+    {
+        assert(at + num <= size());
+        unindex(sdata() + at, sdata() + at + num);
+        countFrees(num);
+        return dropSlots(at, num);
+    }
+
+    // Closes num slots which elements are destroyed or handed over already
+    iterator dropSlots(size_t at, size_t num)
+    {
+        size_t s = size();
+        erased(at, num);
+        if (at < s - at - num)
+        {
+            // Shift the front part and grow the headroom
+            SHptr *d = sdata();
+            for (size_t i = at; i < at + num; i++)
+                d[i].reset();
+            std::move_backward(d, d + at, d + at + num);
+            countShifts(at);
+            m_head += num;
+            return iterator(sbegin() + at);
+        }
+        countShifts(s - at - num);
+        S_iterator i = vecPTR::erase(sbegin() + at, sbegin() + at + num);
+        if (vecPTR::size() == m_head)
+        {
+            vecPTR::clear();
+            m_head = 0;
+            return vecPTR::end();
+        }
+        return iterator(i);
+    }
+
+public:
     template <class InputIterator>
     void assign(InputIterator first, InputIterator last)
     {
+        prepareBack(std::distance(first, last));
         this->reserve(std::distance(first, last));
         while (first < last)
-            vecPTR::push_back(SHptr(new T(*(first++))));
+            pushItem(makeItem(*(first++)));
     }
 
     void assign(size_t n, const T& val)
     {
+        prepareBack(n);
         this->reserve(n);
         while ((n--) > 0)
-            vecPTR::push_back(SHptr(new T(val)));
+            pushItem(makeItem(val));
     }
 
     void assign(std::initializer_list<T> il)
     {
+        prepareBack(il.size());
         this->reserve(std::distance(il.begin(), il.end()));
         auto i = il.begin();
         while (i != il.end())
-            vecPTR::push_back(SHptr(new T(*(i++))));
+            pushItem(makeItem(*(i++)));
     }
 
     bool empty() const noexcept
     {
-        return vecPTR::empty();
+        return vecPTR::size() == m_head;
     }
 
     bool isEmpty() const noexcept
     {
-        return vecPTR::empty();
+        return vecPTR::size() == m_head;
     }
 
     size_t size() const
     {
-        return vecPTR::size();
+        return vecPTR::size() - m_head;
     }
 
     size_t count() const
     {
-        return vecPTR::size();
+        return vecPTR::size() - m_head;
     }
 
     size_t max_size() const
@@ -304,62 +860,233 @@ public:
 
     size_t capacity() const
     {
-        return vecPTR::capacity();
+        return vecPTR::capacity() - m_head;
     }
 
     void reserve(size_t _n)
     {
-        vecPTR::reserve(_n);
+        size_t cap = vecPTR::capacity();
+        vecPTR::reserve(_n + m_head);
+        countGrowth(cap, vecPTR::size());
     }
 
     void resize(size_t _n)
     {
-        vecPTR::resize(_n);
+        if (_n <= size())
+        {
+            unindex(sdata() + _n, sdata() + size());
+            erased(_n, size() - _n);
+            countFrees(size() - _n);
+            vecPTR::resize(_n + m_head);
+            return;
+        }
+        prepareBack(_n - size());
+        reserve(_n);
+        while (size() < _n)
+            pushItem(makeItem());
     }
 
     void shrink_to_fit()
     {
+        if (m_head > 0)
+        {
+            vecPTR::erase(vecPTR::begin(), sbegin());
+            countShifts(vecPTR::size());
+            m_head = 0;
+        }
+        size_t cap = vecPTR::capacity();
         vecPTR::shrink_to_fit();
+        countGrowth(cap, vecPTR::size());
     }
 
     SHptr* data()
     {
-        return vecPTR::data();
+        return sdata();
+    }
+
+    /*
+     * Memory taken by the pointer array and elements. The allocator overhead
+     * of elements is estimated for the std::allocator only, it's O(n).
+     */
+    PtrListMemoryUsage memoryUsage() const
+    {
+        PtrListMemoryUsage usage;
+        size_t cap = vecPTR::capacity();
+        if (cap > 0)
+        {
+            usage.pointerArray = sizeof(SHptr) * cap;
+            usage.slack = sizeof(SHptr) * (cap - size());
+            usage.overhead += PtrListMemoryUsage::blockOverhead(vecPTR::data(), usage.pointerArray);
+        }
+        usage.elements = sizeof(T) * size();
+        if (std::is_same<_Alloc, std::allocator<T> >::value)
+        {
+            for (S_const_iterator i = sbegin(); i != vecPTR::end(); i++)
+                usage.overhead += PtrListMemoryUsage::blockOverhead(i->get(), sizeof(T));
+        }
+        return usage;
+    }
+
+    /*
+     * Hash index: makes contains(), indexOf(), find() and removal by value
+     * to don't walk the whole list. Elements must not change their hashed
+     * content while they are in the list, or reindex() must be called after.
+     */
+
+    // Index elements by std::hash<T> of their content
+    void enableIndex()
+    {
+        setIndex(new PtrListIndex<T>(PtrListValueHasher<T>()));
+    }
+
+    // Index elements by std::hash of the key given by keyFn(const T&)
+    template<class KeyFn>
+    void enableIndex(KeyFn keyFn)
+    {
+        setIndex(new PtrListIndex<T>(PtrListKeyHasher<T, KeyFn>(keyFn)));
+    }
+
+    void disableIndex()
+    {
+        m_index.reset();
+    }
+
+    bool isIndexed() const
+    {
+        return m_index != nullptr;
+    }
+
+    void reindex()
+    {
+        if (!m_index)
+            return;
+        m_index->clear();
+        m_index->reserve(size());
+        for (S_iterator i = sbegin(); i != vecPTR::end(); i++)
+            m_index->added(i->get());
+    }
+
+    /*
+     * Lookups by the address of element. Without any index they compare
+     * pointers only, the address index (or the hash index, which keeps the
+     * same positions) makes them amortised O(1).
+     */
+
+    void enableAddressIndex()
+    {
+        if (!m_positions)
+            m_positions.reset(new PtrListPositions<T>());
+    }
+
+    void disableAddressIndex()
+    {
+        m_positions.reset();
+    }
+
+    bool isAddressIndexed() const
+    {
+        return m_positions != nullptr;
+    }
+
+    // Position of the element which has the given address, or -1 if it's not in the list
+    ssize_t indexOfPtr(const T *p) const
+    {
+        size_t s = size(), at = s;
+        const SHptr *d = sdata();
+        if (m_positions)
+        {
+            size_t visits = m_positions->visits();
+            at = m_positions->position(p, d, s);
+            countIndexVisits(m_positions->visits() - visits);
+        }
+        else if (m_index)
+        {
+            size_t visits = m_index->visits();
+            at = m_index->position(p, d, s);
+            countIndexVisits(m_index->visits() - visits);
+        }
+        else
+        {
+            for (size_t i = 0; i < s; i++)
+            {
+                if (d[i].get() == p)
+                {
+                    at = i;
+                    break;
+                }
+            }
+        }
+        return at < s ? ssize_t(at) : -1;
+    }
+
+    iterator iteratorFor(T *p)
+    {
+        ssize_t at = indexOfPtr(p);
+        return at < 0 ? end() : iterator(sbegin() + at);
+    }
+
+    // Removes exactly this element even if there are equal ones, returns false if it's not in the list
+    bool removeByPtr(T *p)
+    {
+        ssize_t at = indexOfPtr(p);
+        if (at < 0)
+            return false;
+        removeItems(size_t(at), 1);
+        return true;
     }
 
     bool contains(const T &item) const
     {
+        if (m_index)
+            return m_index->contains(item);
         return indexOf(item) >= 0;
     }
 
     ssize_t indexOf(const T &item) const
     {
-        size_t s = vecPTR::size();
-        const SHptr *d = vecPTR::data();
+        if (m_index)
+            return m_index->indexOf(item, sdata(), size());
+        size_t s = size();
+        const SHptr *d = sdata();
         size_t i = 0;
         for (; i < s; i++)
         {
             if (*d[i] == item)
+            {
+                countComparisons(i + 1);
                 return ssize_t(i);
+            }
         }
+        countComparisons(s);
         return -1;
     }
 
     ssize_t lastIndexOf(const T &item) const
     {
-        ssize_t     s = vecPTR::size();
-        const SHptr *d = vecPTR::data();
+        if (m_index)
+            return m_index->indexOf(item, sdata(), size(), true);
+        ssize_t     s = size();
+        const SHptr *d = sdata();
         ssize_t     i = s - 1;
         for (; i >= 0; i--)
         {
             if (*d[i] == item)
+            {
+                countComparisons(size_t(s - i));
                 return ssize_t(i);
+            }
         }
+        countComparisons(size_t(s));
         return -1;
     }
 
     iterator find(const T &item)
     {
+        if (m_index)
+        {
+            ssize_t at = indexOf(item);
+            return at < 0 ? end() : iterator(sbegin() + at);
+        }
         return this->find(item, this->begin());
     }
 
@@ -424,85 +1151,315 @@ public:
 
     void clear()
     {
+        if (m_index)
+            m_index->clear();
+        if (m_positions)
+            m_positions->clear();
+        countFrees(size());
         vecPTR::clear();
+        m_head = 0;
+    }
+
+    bool removeOne(const T &item)
+    {
+        if (m_index)
+        {
+            ssize_t at = indexOf(item);
+            if (at < 0)
+                return false;
+            removeItems(size_t(at), 1);
+            return true;
+        }
+        size_t compared = 0;
+        bool removed = removeOneIf([&item, &compared](const T &v) { compared++; return v == item; });
+        countComparisons(compared);
+        return removed;
+    }
+
+    size_t removeAll(const T &item)
+    {
+        if (m_index && !m_index->contains(item))
+            return 0;
+        countComparisons(size());
+        return removeIf([&item](const T &v) { return v == item; });
     }
 
-    void removeOne(const T &item)
+    template<class Predicate>
+    bool removeOneIf(Predicate pred)
     {
-        S_iterator i = vecPTR::begin();
-        for (; i != vecPTR::end(); i++)
+        size_t s = size();
+        const SHptr *d = sdata();
+        for (size_t i = 0; i < s; i++)
         {
-            if (**i == item)
+            if (pred(*d[i]))
             {
-                vecPTR::erase(i);
-                break;
+                removeItems(i, 1);
+                return true;
             }
         }
+        return false;
     }
 
-    void removeAll(const T &item)
+    // Removes all matching elements by one pass, returns count of removed
+    template<class Predicate>
+    size_t removeIf(Predicate pred)
     {
-        S_iterator i = vecPTR::begin();
-        for (; i != vecPTR::end();)
+        size_t s = size(), moveTo = 0, firstRemoved = s, i = 0;
+        SHptr *d = sdata();
+        try
         {
-            if (**i == item)
-                i = vecPTR::erase(i);
-            else
-                i++;
+            for (; i < s; i++)
+            {
+                if (pred(*d[i]))
+                {
+                    unindex(d + i, d + i + 1);
+                    d[i].reset();
+                    if (firstRemoved == s)
+                        firstRemoved = i;
+                    continue;
+                }
+                if (moveTo != i)
+                    d[moveTo] = std::move(d[i]);
+                moveTo++;
+            }
         }
+        catch (...)
+        {
+            // Close the gap left by already removed elements, the rest is kept
+            for (; i < s; i++)
+            {
+                if (moveTo != i)
+                    d[moveTo] = std::move(d[i]);
+                moveTo++;
+            }
+            dropRemovedTail(s, moveTo, firstRemoved);
+            throw;
+        }
+        return dropRemovedTail(s, moveTo, firstRemoved);
     }
 
     iterator erase(iterator pos)
     {
         assert(pos < this->end());
-        return iterator(vecPTR::erase(pos.p));
+        return removeItems(size_t(pos.p - sbegin()), 1);
     }
 
     iterator erase(iterator from, iterator to)
     {
-        assert(from < this->end());
-        assert(to < this->end());
+        assert(from <= this->end());
+        assert(to <= this->end());
         assert(from <= to);
         if (from == to)
             return from;
-        return iterator(vecPTR::erase(from.p, to.p));
+        return removeItems(size_t(from.p - sbegin()), size_t(to.p - from.p));
     }
 
     void removeAt(size_t at)
     {
-        vecPTR::erase(vecPTR::begin() + int(at));
+        removeItems(at, 1);
     }
 
     void removeAt(size_t at, size_t num)
     {
-        vecPTR::erase(vecPTR::begin() + int(at), vecPTR::begin() + int(at + num));
+        removeItems(at, num);
     }
 
     void pop_back()
     {
+        assert(size() > 0);
+        unindex(sdata() + size() - 1, sdata() + size());
+        erased(size() - 1, 1);
+        countFrees(1);
         vecPTR::pop_back();
+        if (vecPTR::size() == m_head)
+            clear();
     }
 
     void pop_front()
     {
-        vecPTR::erase(vecPTR::begin(), vecPTR::begin() + 1);
+        assert(size() > 0);
+        unindex(sdata(), sdata() + 1);
+        erased(0, 1);
+        countFrees(1);
+        sdata()[0].reset();
+        m_head++;
+        if (vecPTR::size() == m_head)
+            clear();
+    }
+
+    /*
+     * Unordered removal: the last element takes the slot of removed one,
+     * so nothing is shifted and the removal is O(1), but the order isn't kept
+     */
+
+    void removeAtUnordered(size_t at)
+    {
+        assert(at < size());
+        size_t last = size() - 1;
+        if (at != last)
+        {
+            swap(at, last);
+            countShifts(1);
+        }
+        pop_back();
+    }
+
+    bool removeOneUnordered(const T &item)
+    {
+        ssize_t at = indexOf(item);
+        if (at < 0)
+            return false;
+        removeAtUnordered(size_t(at));
+        return true;
+    }
+
+    // Removes all matching elements by one pass, returns count of removed
+    template<class Predicate>
+    size_t removeIfUnordered(Predicate pred)
+    {
+        size_t removed = 0, i = 0;
+        while (i < size())
+        {
+            // The element moved into this slot is checked on the next step
+            if (pred(*sdata()[i]))
+            {
+                removeAtUnordered(i);
+                removed++;
+            }
+            else
+                i++;
+        }
+        return removed;
+    }
+
+    /*
+     * Ownership transfer: elements are handed over between lists, or to and from
+     * the caller, without any copy or allocation, so they keep their addresses.
+     * Elements carry their deleter, so they are released through the allocator
+     * of the list which has created them.
+     */
+
+    // Removes the element from the list without destroying it
+    SHptr takeAt(size_t at)
+    {
+        assert(at < size());
+        unindex(sdata() + at, sdata() + at + 1);
+        SHptr item = std::move(sdata()[at]);
+        dropSlots(at, 1);
+        return item;
+    }
+
+    // The caller must delete the element (or release it through the allocator)
+    T *release(size_t at)
+    {
+        return takeAt(at).release();
+    }
+
+    void adopt(SHptr &&item)
+    {
+        assert(item);
+        prepareBack();
+        pushItem(std::move(item));
+    }
+
+    void adopt(size_t at, SHptr &&item)
+    {
+        assert(item);
+        insertItem(at, std::move(item));
+    }
+
+    // Appends the element created by new (or through the element allocator)
+    void adopt(T *p)
+    {
+        adopt(SHptr(p, Elements::deleter(AllocHolder::elementAllocator())));
+    }
+
+    void adopt(size_t at, T *p)
+    {
+        adopt(at, SHptr(p, Elements::deleter(AllocHolder::elementAllocator())));
+    }
+
+    /*
+     * Moves elements [srcFirst, srcLast) of src list to the position dstPos of
+     * this list by one shift of every list. Elements are spliced inside of the
+     * same list too (dstPos is given as a position before the move).
+     */
+    void splice(size_t dstPos, VPtrList &src, size_t srcFirst, size_t srcLast)
+    {
+        assert(srcFirst <= srcLast && srcLast <= src.size());
+        assert(dstPos <= size());
+        if (&src == this)
+        {
+            spliceSelf(dstPos, srcFirst, srcLast);
+            return;
+        }
+
+        size_t num = srcLast - srcFirst;
+        if (num == 0)
+            return;
+        SHptr *items = src.sdata() + srcFirst;
+        src.unindex(items, items + num);
+        try
+        {
+            placeItems(dstPos, items, num);
+        }
+        catch(...)
+        {
+            // The elements are back in their slots of src
+            src.reindex();
+            throw;
+        }
+        src.dropSlots(srcFirst, num);
+    }
+
+    // Moves all elements of src list to the position dstPos
+    void splice(size_t dstPos, VPtrList &src)
+    {
+        splice(dstPos, src, 0, src.size());
+    }
+
+    /*
+     * Gives the vector of elements away in O(1) (a headroom costs a shift of
+     * pointers), the list becomes empty
+     */
+    vecPTR takeStorage()
+    {
+        if (m_index)
+            m_index->clear();
+        if (m_positions)
+            m_positions->clear();
+        if (m_head > 0)
+        {
+            vecPTR::erase(vecPTR::begin(), sbegin());
+            countShifts(vecPTR::size());
+            m_head = 0;
+        }
+        vecPTR items(std::move(static_cast<vecPTR&>(*this)));
+        vecPTR::clear();
+        return items;
     }
 
     void swap(size_t from, size_t to)
     {
         if (from == to)
             return;
-        std::swap(*(vecPTR::begin() + from), *(vecPTR::begin() + to));
+        std::swap(*(sbegin() + from), *(sbegin() + to));
+        if (m_index)
+            m_index->swapped(sdata()[from].get(), from, sdata()[to].get(), to);
+        if (m_positions)
+            m_positions->swapped(sdata()[from].get(), from, sdata()[to].get(), to);
     }
 
     void move(size_t from, size_t to)
     {
-        size_t m_size = vecPTR::size();
-        SHptr *m_data = vecPTR::data();
+        size_t m_size = size();
+        SHptr *m_data = sdata();
         assert(m_size > from);
         assert(m_size > to);
         if (from == to)
             return;
+        shifted(from < to ? from : to);
+        countShifts(from < to ? to - from : from - to);
         if (from < to)
         {
             SHptr it = std::move(m_data[from]);
@@ -525,256 +1482,399 @@ public:
         }
     }
 
+    /*
+     * Sorting: only pointers get permuted, elements are never moved,
+     * so external pointers to them are still valid
+     */
+    template<class Compare>
+    void sort(Compare cmp)
+    {
+        std::sort(sdata(), sdata() + size(), [&cmp](const SHptr &a, const SHptr &b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void sort()
+    {
+        sort(std::less<T>());
+    }
+
+    template<class Compare>
+    void stable_sort(Compare cmp)
+    {
+        std::stable_sort(sdata(), sdata() + size(), [&cmp](const SHptr &a, const SHptr &b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void stable_sort()
+    {
+        stable_sort(std::less<T>());
+    }
+
+    /*
+     * Stable sort on multiple threads, gives the same result as stable_sort().
+     * threads = 0 uses all hardware threads, lists with less than `threshold`
+     * elements per thread are sorted on the calling thread.
+     * Comparator must not throw and must be safe to call from multiple threads.
+     */
+    template<class Compare>
+    void parallel_sort(Compare cmp, unsigned threads = 0,
+                       size_t threshold = PtrListSort::defaultParallelThreshold)
+    {
+        PtrListSort::parallelStable(sdata(), size(), [cmp](const SHptr &a, const SHptr &b) { return cmp(*a, *b); },
+                                    threads, threshold);
+        shifted(0);
+    }
+
+    void parallel_sort()
+    {
+        parallel_sort(std::less<T>());
+    }
+
+    /*
+     * Stable sort by the key returned by keyFn(const T&): keys are taken once
+     * into a contiguous array, and integral or floating point keys are sorted
+     * by the radix sort, so elements are not dereferenced while sorting
+     */
+    template<class KeyFn>
+    void sortByKey(KeyFn keyFn)
+    {
+        PtrListSort::byKey(sdata(), size(), [&keyFn](const SHptr &p) { return keyFn(*p); });
+        shifted(0);
+    }
+
+    // Sorts the first `middle` elements, rest of elements are in unspecified order
+    template<class Compare>
+    void partial_sort(size_t middle, Compare cmp)
+    {
+        assert(middle <= size());
+        std::partial_sort(sdata(), sdata() + middle, sdata() + size(), [&cmp](const SHptr &a, const SHptr &b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void partial_sort(size_t middle)
+    {
+        partial_sort(middle, std::less<T>());
+    }
+
+    // Puts to the nth position the element which would be there in a sorted list
+    template<class Compare>
+    void nth_element(size_t nth, Compare cmp)
+    {
+        assert(nth < size());
+        std::nth_element(sdata(), sdata() + nth, sdata() + size(), [&cmp](const SHptr &a, const SHptr &b) { return cmp(*a, *b); });
+        shifted(0);
+    }
+
+    void nth_element(size_t nth)
+    {
+        nth_element(nth, std::less<T>());
+    }
+
     void push_back(const T &item)
     {
-        vecPTR::push_back(SHptr(new T(item)));
+        prepareBack();
+        pushItem(makeItem(item));
     }
 
     void push_back(T &&item)
     {
-        vecPTR::emplace_back(SHptr(new T(std::move(item))));
+        prepareBack();
+        pushItem(makeItem(std::move(item)));
     }
 
     template<typename... _Args>
     void emplace_back(_Args&&... __args)
     {
-        vecPTR::emplace_back(std::move(SHptr(new T(std::forward<_Args>(__args)...))));
+        prepareBack();
+        pushItem(makeItem(std::forward<_Args>(__args)...));
     }
 
     void push_front(const T &item)
     {
-        vecPTR::insert(begin(), SHptr(new T(item)));
+        insertItem(0, makeItem(item));
     }
 
     void push_front(T &&item)
     {
-        vecPTR::insert(begin(), SHptr(new T(std::move(item))));
+        insertItem(0, makeItem(std::move(item)));
     }
 
     template<typename... _Args>
     iterator emplace(const_iterator pos, _Args&&... __args)
     {
-        return vecPTR::emplace(pos.p, std::move(SHptr(new T(std::forward<_Args>(__args)...))));
+        return insertItem(size_t(pos.p - sbegin()), makeItem(std::forward<_Args>(__args)...));
     }
 
     void append(const T &item)
     {
-        vecPTR::push_back(SHptr(new T(item)));
+        prepareBack();
+        pushItem(makeItem(item));
+    }
+
+    void append(const VPtrList &array)
+    {
+        insert(size(), array);
+    }
+
+    // Elements of other list are handed over, other list becomes empty
+    void append(VPtrList &&array)
+    {
+        insert(size(), std::move(array));
+    }
+
+    template<class InputIt, class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void append(InputIt first, InputIt last)
+    {
+        insert(size(), first, last);
     }
 
-    void append(const VPtrList<T> &array)
+    void append(std::initializer_list<T> il)
     {
-        vecPTR::reserve(array.size());
-        for (const T &t : array)
-            vecPTR::push_back(SHptr(new T(t)));
+        insertRange(size(), il.size(), il.begin());
     }
 
     iterator insert(size_t at, const T &item)
     {
-        return iterator(vecPTR::insert(vecPTR::begin() + int(at), SHptr(new T(item))));
+        return insertItem(at, makeItem(item));
+    }
+
+    iterator insert(size_t at, T &&item)
+    {
+        return insertItem(at, makeItem(std::move(item)));
+    }
+
+    /*
+     * Range insertions: new elements are created first, then their pointers are
+     * put by one shift and at most one reallocation of the pointer array
+     */
+
+    // Iterators must be at least forward ones and must not point into this list
+    template<class InputIt, class = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void insert(size_t at, InputIt first, InputIt last)
+    {
+        insertRange(at, size_t(std::distance(first, last)), first);
+    }
+
+    void insert(size_t at, std::initializer_list<T> il)
+    {
+        insertRange(at, il.size(), il.begin());
+    }
+
+    void insert(size_t at, const VPtrList &array)
+    {
+        insertRange(at, array.size(), array.begin());
+    }
+
+    // Elements of other list are handed over, other list becomes empty
+    void insert(size_t at, VPtrList &&array)
+    {
+        if (this == &array)
+            return;
+        splice(at, array);
+        array.clear();
     }
 
     iterator insert(const_iterator pos, const T &item)
     {
-        iterator(vecPTR::insert(pos.p, SHptr(new T(item))));
+        return insertItem(size_t(pos.p - sbegin()), makeItem(item));
     }
 
     iterator insert(const_iterator pos, T &&item)
     {
-        iterator(vecPTR::insert(pos.p, SHptr(new T(std::move(item)))));
+        return insertItem(size_t(pos.p - sbegin()), makeItem(std::move(item)));
     }
 
     T &last()
     {
-        assert(vecPTR::size() > 0);
+        assert(size() > 0);
         return *vecPTR::back();
     }
 
     T &first()
     {
-        assert(vecPTR::size() > 0);
-        return *vecPTR::front();
+        assert(size() > 0);
+        return *sdata()[0];
     }
 
     T &back()
     {
-        assert(vecPTR::size() > 0);
+        assert(size() > 0);
         return *vecPTR::back();
     }
 
     T &front()
     {
-        assert(vecPTR::size() > 0);
-        return *vecPTR::front();
+        assert(size() > 0);
+        return *sdata()[0];
     }
 
     const T &last() const
     {
-        assert(vecPTR::size() > 0);
+        assert(size() > 0);
         return *vecPTR::back();
     }
 
     const T &first() const
     {
-        assert(vecPTR::size() > 0);
-        return *vecPTR::front();
+        assert(size() > 0);
+        return *sdata()[0];
     }
 
     const T &back() const
     {
-        assert(vecPTR::size() > 0);
+        assert(size() > 0);
         return *vecPTR::back();
     }
 
     const T &front() const
     {
-        assert(vecPTR::size() > 0);
-        return *vecPTR::front();
+        assert(size() > 0);
+        return *sdata()[0];
     }
 
     T &at(unsigned int index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &at(int index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &at(unsigned long index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &at(long index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &at(unsigned long long index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &at(long long index)
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(unsigned int index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(int index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(unsigned long index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(long index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(unsigned long long index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &at(long long index) const
     {
-        return *(vecPTR::at(static_cast<size_t>(index)));
+        return checkedAt(static_cast<size_t>(index));
     }
 
 
     T &operator[](unsigned int index)
     {
-        assert(index < static_cast<unsigned int>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned int>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &operator[](int index)
     {
         assert(index >= 0);
-        assert(index < static_cast<int>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<int>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &operator[](unsigned long index)
     {
-        assert(index < static_cast<unsigned long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &operator[](long index)
     {
         assert(index >= 0);
-        assert(index < static_cast<unsigned long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &operator[](unsigned long long index)
     {
-        assert(index < static_cast<unsigned long long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     T &operator[](long long index)
     {
         assert(index >= 0);
-        assert(index < static_cast<long long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<long long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
 
     const T &operator[](unsigned int index) const
     {
-        assert(index < static_cast<unsigned int>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned int>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &operator[](int index) const
     {
         assert(index >= 0);
-        assert(index < static_cast<int>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<int>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &operator[](unsigned long index) const
     {
-        assert(index < static_cast<unsigned long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &operator[](long index) const
     {
         assert(index >= 0);
-        assert(index < static_cast<unsigned long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &operator[](unsigned long long index) const
     {
-        assert(index < static_cast<unsigned long long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<unsigned long long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     const T &operator[](long long index) const
     {
         assert(index >= 0);
-        assert(index < static_cast<long long>(vecPTR::size()));
-        return *(vecPTR::at(index));
+        assert(index < static_cast<long long>(size()));
+        return checkedAt(static_cast<size_t>(index));
     }
 
     allocator_type get_allocator() const noexcept
     {
-        return vecPTR::get_allocator();
+        return AllocHolder::elementAllocator();
     }
 };
 